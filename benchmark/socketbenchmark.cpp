@@ -0,0 +1,491 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+/**
+ * Loopback benchmark of the socket module. Every run starts an echo SocketServer and a number of SocketClients on a
+ * single SocketThread. Each client keeps a window of messages in flight, a message carries the time it was sent and is
+ * sent again as soon as its echo arrives. The benchmark sweeps message sizes, client counts, update methods and
+ * transports, and writes one JSON object per run to stdout or the file passed with --output.
+ *
+ * Usage: napsocketbenchmark [--sizes 64,1024,16384] [--clients 1,4,16] [--modes main,spawn,manual,event]
+ *                           [--transports tcp,local,shm] [--window 16] [--duration 2] [--warmup 0.5]
+ *                           [--port 13260] [--output results.jsonl]
+ */
+
+// Local includes
+#include <socketservice.h>
+#include <socketthread.h>
+#include <socketserver.h>
+#include <socketclient.h>
+#include <socketframing.h>
+#include <socketmetrics.h>
+
+// External includes
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace nap
+{
+    namespace benchmark
+    {
+        // every message starts with the time it was sent
+        static constexpr size_t sTimestampSize = sizeof(uint64);
+
+        /**
+         * Exposes the update call of the service, drives SocketThreads with the MAIN_THREAD update method
+         */
+        class BenchmarkService : public SocketService
+        {
+        public:
+            BenchmarkService() : SocketService(nullptr)         { }
+            void tick()                                         { update(0.0); }
+        };
+
+
+        /**
+         * Benchmark settings, parsed from the command line
+         */
+        struct Settings
+        {
+            std::vector<size_t>                     mSizes = { 64, 1024, 16384 };
+            std::vector<int>                        mClients = { 1, 4, 16 };
+            std::vector<ESocketThreadUpdateMethod>  mModes = { ESocketThreadUpdateMethod::MAIN_THREAD, ESocketThreadUpdateMethod::SPAWN_OWN_THREAD,
+                                                               ESocketThreadUpdateMethod::MANUAL, ESocketThreadUpdateMethod::EVENT_DRIVEN };
+            std::vector<ESocketTransport>           mTransports = { ESocketTransport::TCP };
+            int                                     mWindow = 16;
+            double                                  mDuration = 2.0;
+            double                                  mWarmup = 0.5;
+            int                                     mPort = 13260;
+            std::string                             mOutput;
+        };
+
+
+        /**
+         * Result of a single run
+         */
+        struct Result
+        {
+            ESocketThreadUpdateMethod   mMode;
+            ESocketTransport            mTransport;
+            int                         mClients = 0;
+            size_t                      mSize = 0;
+            double                      mDuration = 0.0;
+            uint64                      mMessages = 0;
+            SocketLatencySnapshot       mLatency;
+            bool                        mConnected = false;
+        };
+
+
+        static const char* toString(ESocketThreadUpdateMethod mode)
+        {
+            switch(mode)
+            {
+            case ESocketThreadUpdateMethod::MAIN_THREAD:        return "main";
+            case ESocketThreadUpdateMethod::SPAWN_OWN_THREAD:   return "spawn";
+            case ESocketThreadUpdateMethod::MANUAL:             return "manual";
+            case ESocketThreadUpdateMethod::EVENT_DRIVEN:       return "event";
+            }
+            return "unknown";
+        }
+
+
+        static const char* toString(ESocketTransport transport)
+        {
+            switch(transport)
+            {
+            case ESocketTransport::TCP:             return "tcp";
+            case ESocketTransport::LOCAL:           return "local";
+            case ESocketTransport::SHARED_MEMORY:   return "shm";
+            }
+            return "unknown";
+        }
+
+
+        static std::vector<std::string> split(const std::string& value)
+        {
+            std::vector<std::string> items;
+            std::stringstream stream(value);
+            std::string item;
+            while(std::getline(stream, item, ','))
+            {
+                if(!item.empty())
+                    items.emplace_back(item);
+            }
+            return items;
+        }
+
+
+        static bool parseSettings(int argc, char* argv[], Settings& settings, utility::ErrorState& errorState)
+        {
+            for(int i = 1; i < argc; i++)
+            {
+                std::string option = argv[i];
+                if(!errorState.check(i + 1 < argc, "Missing value for %s", option.c_str()))
+                    return false;
+
+                std::string value = argv[++i];
+                if(option == "--sizes")
+                {
+                    settings.mSizes.clear();
+                    for(const auto& item : split(value))
+                        settings.mSizes.emplace_back(std::max<size_t>(std::strtoull(item.c_str(), nullptr, 10), sTimestampSize));
+                }
+                else if(option == "--clients")
+                {
+                    settings.mClients.clear();
+                    for(const auto& item : split(value))
+                        settings.mClients.emplace_back(std::max(std::atoi(item.c_str()), 1));
+                }
+                else if(option == "--modes")
+                {
+                    settings.mModes.clear();
+                    for(const auto& item : split(value))
+                    {
+                        bool found = false;
+                        for(auto mode : { ESocketThreadUpdateMethod::MAIN_THREAD, ESocketThreadUpdateMethod::SPAWN_OWN_THREAD,
+                                          ESocketThreadUpdateMethod::MANUAL, ESocketThreadUpdateMethod::EVENT_DRIVEN })
+                        {
+                            if(item == toString(mode))
+                            {
+                                settings.mModes.emplace_back(mode);
+                                found = true;
+                            }
+                        }
+                        if(!errorState.check(found, "Unknown update method: %s", item.c_str()))
+                            return false;
+                    }
+                }
+                else if(option == "--transports")
+                {
+                    settings.mTransports.clear();
+                    for(const auto& item : split(value))
+                    {
+                        bool found = false;
+                        for(auto transport : { ESocketTransport::TCP, ESocketTransport::LOCAL, ESocketTransport::SHARED_MEMORY })
+                        {
+                            if(item == toString(transport))
+                            {
+                                settings.mTransports.emplace_back(transport);
+                                found = true;
+                            }
+                        }
+                        if(!errorState.check(found, "Unknown transport: %s", item.c_str()))
+                            return false;
+                    }
+                }
+                else if(option == "--window")
+                {
+                    settings.mWindow = std::max(std::atoi(value.c_str()), 1);
+                }
+                else if(option == "--duration")
+                {
+                    settings.mDuration = std::atof(value.c_str());
+                }
+                else if(option == "--warmup")
+                {
+                    settings.mWarmup = std::atof(value.c_str());
+                }
+                else if(option == "--port")
+                {
+                    settings.mPort = std::atoi(value.c_str());
+                }
+                else if(option == "--output")
+                {
+                    settings.mOutput = value;
+                }
+                else
+                {
+                    errorState.fail("Unknown option: %s", option.c_str());
+                    return false;
+                }
+            }
+
+            return errorState.check(!settings.mSizes.empty() && !settings.mClients.empty() && !settings.mModes.empty() &&
+                                    !settings.mTransports.empty(), "Nothing to run") &&
+                   errorState.check(settings.mDuration > 0.0, "Duration must be larger than 0");
+        }
+
+
+        /**
+         * A client of the benchmark, sends the echoed message back immediately
+         */
+        class BenchmarkClient
+        {
+        public:
+            BenchmarkClient(SocketClient& client, size_t size, std::atomic_bool& running, std::atomic<uint64>& received, SocketLatencyHistogram& latency) :
+                mClient(client), mMessage(size, 'x'), mRunning(running), mReceived(received), mLatency(latency)
+            {
+                mClient.addMessageViewReceivedSlot(mMessageReceivedSlot);
+            }
+
+            ~BenchmarkClient()
+            {
+                mClient.removeMessageViewReceivedSlot(mMessageReceivedSlot);
+            }
+
+            /**
+             * Fills the window of messages in flight
+             */
+            void start(int window)
+            {
+                for(int i = 0; i < window; i++)
+                    send();
+            }
+
+        private:
+            void send()
+            {
+                uint64 time = SocketMetrics::now();
+                std::memcpy(&mMessage[0], &time, sTimestampSize);
+                mClient.send(mMessage);
+            }
+
+            void onMessageReceived(std::string_view message)
+            {
+                if(message.size() < sTimestampSize)
+                    return;
+
+                uint64 sent;
+                std::memcpy(&sent, message.data(), sTimestampSize);
+                uint64 time = SocketMetrics::now();
+                mLatency.record(time > sent ? time - sent : 0);
+                mReceived.fetch_add(1, std::memory_order_relaxed);
+
+                if(mRunning.load(std::memory_order_relaxed))
+                    send();
+            }
+
+            SocketClient&               mClient;
+            std::string                 mMessage;
+            std::atomic_bool&           mRunning;
+            std::atomic<uint64>&        mReceived;
+            SocketLatencyHistogram&     mLatency;
+            Slot<std::string_view>      mMessageReceivedSlot = { this, &BenchmarkClient::onMessageReceived };
+        };
+
+
+        /**
+         * Waits for the given number of seconds, driving the thread when its update method requires it
+         */
+        static void wait(BenchmarkService& service, SocketThread& thread, double seconds)
+        {
+            auto end = std::chrono::steady_clock::now() + std::chrono::duration<double>(seconds);
+            while(std::chrono::steady_clock::now() < end)
+            {
+                switch(thread.mUpdateMethod)
+                {
+                case ESocketThreadUpdateMethod::MAIN_THREAD:
+                    service.tick();
+                    break;
+                case ESocketThreadUpdateMethod::MANUAL:
+                    thread.manualProcess();
+                    break;
+                default:
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                    break;
+                }
+            }
+        }
+
+
+        static bool run(BenchmarkService& service, const Settings& settings, ESocketThreadUpdateMethod mode, ESocketTransport transport,
+                        int clientCount, size_t size, Result& result, utility::ErrorState& errorState)
+        {
+            result.mMode = mode;
+            result.mTransport = transport;
+            result.mClients = clientCount;
+            result.mSize = size;
+
+            std::string local_path = utility::stringFormat("@napsocketbenchmark-%d", settings.mPort);
+
+            LengthPrefixFraming framing;
+            if(!framing.init(errorState))
+                return false;
+
+            SocketThread thread(service);
+            thread.mUpdateMethod = mode;
+            if(!thread.init(errorState))
+                return false;
+
+            // echo every message back to the connection it came from
+            SocketServer server;
+            server.mThread = &thread;
+            server.mPort = settings.mPort;
+            server.mIPAddress = "127.0.0.1";
+            server.mTransport = transport;
+            server.mLocalPath = local_path;
+            server.mFraming = &framing;
+            server.mEnableConnectionLabels = false;
+            server.mCopyReceivedMessages = false;
+            Slot<SocketConnectionHandle, std::string_view> echo_slot([&server](SocketConnectionHandle handle, std::string_view message)
+            {
+                server.send(handle, std::string(message));
+            });
+            server.connectionMessageViewReceived.connect(echo_slot);
+
+            // tears down every initialized adapter on all exit paths, closing the clients before the server. Handlers
+            // still pending are discarded when the thread stops
+            bool server_initialized = false;
+            std::vector<std::unique_ptr<SocketClient>> clients;
+            auto teardown = [&]()
+            {
+                for(auto& client : clients)
+                    client->onDestroy();
+                if(server_initialized)
+                    server.onDestroy();
+                thread.stop();
+            };
+
+            server_initialized = server.init(errorState);
+            if(!server_initialized)
+            {
+                teardown();
+                return false;
+            }
+
+            for(int i = 0; i < clientCount; i++)
+            {
+                auto client = std::make_unique<SocketClient>();
+                client->mThread = &thread;
+                client->mPort = settings.mPort;
+                client->mRemoteIp = "127.0.0.1";
+                client->mTransport = transport;
+                client->mLocalPath = local_path;
+                client->mFraming = &framing;
+                client->mCopyReceivedMessages = false;
+                client->mAutoReconnectIntervalMillis = 100;
+                if(!client->init(errorState))
+                {
+                    teardown();
+                    return false;
+                }
+                clients.emplace_back(std::move(client));
+            }
+
+            if(!thread.start(errorState))
+            {
+                teardown();
+                return false;
+            }
+
+            // wait for all clients to connect
+            auto connect_deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+            result.mConnected = false;
+            while(!result.mConnected && std::chrono::steady_clock::now() < connect_deadline)
+            {
+                wait(service, thread, 0.01);
+                result.mConnected = server.getConnectedClientsCount() == clients.size();
+                for(const auto& client : clients)
+                    result.mConnected = result.mConnected && client->isConnected();
+            }
+
+            std::atomic_bool running = { true };
+            std::atomic<uint64> received = { 0 };
+            SocketLatencyHistogram latency;
+            std::vector<std::unique_ptr<BenchmarkClient>> benchmark_clients;
+            if(result.mConnected)
+            {
+                for(auto& client : clients)
+                    benchmark_clients.emplace_back(std::make_unique<BenchmarkClient>(*client, size, running, received, latency));
+                for(auto& client : benchmark_clients)
+                    client->start(settings.mWindow);
+
+                // measure from the end of the warmup
+                wait(service, thread, settings.mWarmup);
+                latency.reset();
+                uint64 start_count = received.load();
+                auto start_time = std::chrono::steady_clock::now();
+
+                wait(service, thread, settings.mDuration);
+                result.mMessages = received.load() - start_count;
+                result.mDuration = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+                result.mLatency = latency.getSnapshot();
+                running.store(false);
+            }
+
+            teardown();
+            return true;
+        }
+
+
+        static std::string toJSON(const Result& result)
+        {
+            double messages_per_second = result.mDuration > 0.0 ? static_cast<double>(result.mMessages) / result.mDuration : 0.0;
+            return utility::stringFormat("{\"mode\":\"%s\",\"transport\":\"%s\",\"clients\":%d,\"message_size\":%zu,\"connected\":%s,"
+                                         "\"duration_s\":%.3f,\"messages\":%llu,\"messages_per_s\":%.1f,\"bytes_per_s\":%.1f,"
+                                         "\"latency_ns\":{\"count\":%llu,\"mean\":%llu,\"p50\":%llu,\"p90\":%llu,\"p99\":%llu,\"p999\":%llu,\"max\":%llu}}",
+                toString(result.mMode), toString(result.mTransport), result.mClients, result.mSize, result.mConnected ? "true" : "false",
+                result.mDuration, static_cast<unsigned long long>(result.mMessages), messages_per_second,
+                messages_per_second * static_cast<double>(result.mSize),
+                static_cast<unsigned long long>(result.mLatency.mCount), static_cast<unsigned long long>(result.mLatency.mMean),
+                static_cast<unsigned long long>(result.mLatency.mP50), static_cast<unsigned long long>(result.mLatency.mP90),
+                static_cast<unsigned long long>(result.mLatency.mP99), static_cast<unsigned long long>(result.mLatency.mP999),
+                static_cast<unsigned long long>(result.mLatency.mMax));
+        }
+    }
+}
+
+
+int main(int argc, char* argv[])
+{
+    using namespace nap;
+    using namespace nap::benchmark;
+
+    utility::ErrorState error_state;
+    Settings settings;
+    if(!parseSettings(argc, argv, settings, error_state))
+    {
+        std::cerr << error_state.toString() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::ofstream file;
+    if(!settings.mOutput.empty())
+    {
+        file.open(settings.mOutput);
+        if(!file.is_open())
+        {
+            std::cerr << "Unable to open " << settings.mOutput << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+    std::ostream& output = file.is_open() ? static_cast<std::ostream&>(file) : std::cout;
+
+    BenchmarkService service;
+    for(auto transport : settings.mTransports)
+    {
+        for(auto mode : settings.mModes)
+        {
+            for(int client_count : settings.mClients)
+            {
+                for(size_t size : settings.mSizes)
+                {
+                    Result result;
+                    if(!run(service, settings, mode, transport, client_count, size, result, error_state))
+                    {
+                        std::cerr << error_state.toString() << std::endl;
+                        return EXIT_FAILURE;
+                    }
+
+                    output << toJSON(result) << std::endl;
+                    std::cerr << utility::stringFormat("%s %s %d clients %zu bytes: %.0f msgs/s p50 %.1fus p99 %.1fus p99.9 %.1fus%s",
+                        toString(mode), toString(transport), client_count, size,
+                        result.mDuration > 0.0 ? static_cast<double>(result.mMessages) / result.mDuration : 0.0,
+                        static_cast<double>(result.mLatency.mP50) / 1e3, static_cast<double>(result.mLatency.mP99) / 1e3,
+                        static_cast<double>(result.mLatency.mP999) / 1e3, result.mConnected ? "" : " (not connected)") << std::endl;
+                }
+            }
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -4,13 +4,42 @@
 
 #include "socketadapter.h"
 #include "socketthread.h"
+#include "socketservice.h"
 
 #include <nap/logger.h>
+#include <algorithm>
+#include <cstring>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/un.h>
+#endif
+
+RTTI_BEGIN_ENUM(nap::ESocketTransport)
+	RTTI_ENUM_VALUE(nap::ESocketTransport::TCP,		"TCP"),
+	RTTI_ENUM_VALUE(nap::ESocketTransport::LOCAL,	"Local"),
+	RTTI_ENUM_VALUE(nap::ESocketTransport::SHARED_MEMORY,	"Shared Memory")
+RTTI_END_ENUM
+
+RTTI_BEGIN_ENUM(nap::ESocketSignalDelivery)
+	RTTI_ENUM_VALUE(nap::ESocketSignalDelivery::SOCKET_THREAD,	"Socket Thread"),
+	RTTI_ENUM_VALUE(nap::ESocketSignalDelivery::MAIN_THREAD,	"Main Thread")
+RTTI_END_ENUM
 
 RTTI_BEGIN_CLASS_NO_DEFAULT_CONSTRUCTOR(nap::SocketAdapter)
 	RTTI_PROPERTY("Thread", &nap::SocketAdapter::mThread, nap::rtti::EPropertyMetaData::Required)
     RTTI_PROPERTY("AllowFailure", &nap::SocketAdapter::mAllowFailure, nap::rtti::EPropertyMetaData::Default)
     RTTI_PROPERTY("No Delay", &nap::SocketAdapter::mNoDelay, nap::rtti::EPropertyMetaData::Default)
+    RTTI_PROPERTY("Framing", &nap::SocketAdapter::mFraming, nap::rtti::EPropertyMetaData::Default)
+    RTTI_PROPERTY("Copy Received Messages", &nap::SocketAdapter::mCopyReceivedMessages, nap::rtti::EPropertyMetaData::Default)
+    RTTI_PROPERTY("Batch Received Messages", &nap::SocketAdapter::mBatchReceivedMessages, nap::rtti::EPropertyMetaData::Default)
+    RTTI_PROPERTY("Queue Max Messages", &nap::SocketAdapter::mQueueMaxMessages, nap::rtti::EPropertyMetaData::Default)
+    RTTI_PROPERTY("Queue Max Bytes", &nap::SocketAdapter::mQueueMaxBytes, nap::rtti::EPropertyMetaData::Default)
+    RTTI_PROPERTY("Queue Overflow Policy", &nap::SocketAdapter::mQueueOverflowPolicy, nap::rtti::EPropertyMetaData::Default)
+    RTTI_PROPERTY("Queue Block Timeout", &nap::SocketAdapter::mQueueBlockTimeoutMillis, nap::rtti::EPropertyMetaData::Default)
+    RTTI_PROPERTY("Queue High Watermark", &nap::SocketAdapter::mQueueHighWatermark, nap::rtti::EPropertyMetaData::Default)
+    RTTI_PROPERTY("Queue Low Watermark", &nap::SocketAdapter::mQueueLowWatermark, nap::rtti::EPropertyMetaData::Default)
+    RTTI_PROPERTY("Enable Metrics", &nap::SocketAdapter::mEnableMetrics, nap::rtti::EPropertyMetaData::Default)
+    RTTI_PROPERTY("Signal Delivery", &nap::SocketAdapter::mSignalDelivery, nap::rtti::EPropertyMetaData::Default)
 RTTI_END_CLASS
 
 namespace nap
@@ -24,17 +53,45 @@ namespace nap
 		if(!errorState.check(mThread !=nullptr, "Thread cannot be nullptr"))
 			return false;
 
+		if(!errorState.check(mQueueMaxMessages >= 0 && mQueueMaxBytes >= 0 && mQueueBlockTimeoutMillis >= 0, "Queue limits cannot be negative"))
+			return false;
+
+		if(!errorState.check(mQueueLowWatermark >= 0 && mQueueLowWatermark <= mQueueHighWatermark, "Queue Low Watermark must be between 0 and Queue High Watermark"))
+			return false;
+
+		// queued events are dispatched by the service, register before the adapter starts producing them
+		if(isDeliveredOnMainThread())
+			mThread->mService.registerDeliveryAdapter(this);
+
 		mThread->registerAdapter(this);
+		mRegistered = true;
 		return true;
 	}
 
 
 	void SocketAdapter::onDestroy()
 	{
+		// initialization stopped before the adapter was registered, for example when 'AllowFailure' is set
+		if(!mRegistered)
+			return;
+
+		mRegistered = false;
 		mThread->removeAdapter(this);
+
+		// events still queued are discarded with the adapter
+		if(isDeliveredOnMainThread())
+			mThread->mService.removeDeliveryAdapter(this);
 	}
 
 
+    SocketMetricsSnapshot SocketAdapter::getMetrics() const
+    {
+        auto snapshot = mMetrics.getSnapshot();
+        snapshot.mQueueDepth = getTotalQueueDepth();
+        return snapshot;
+    }
+
+
     bool SocketAdapter::handleAsioError(const asio::error_code& errorCode, utility::ErrorState& errorState, bool& success)
     {
         if(errorCode)
@@ -58,8 +115,268 @@ namespace nap
     }
 
 
+    bool SocketAdapter::dispatchMessages(SocketReceiveBuffer& buffer, size_t& scanned, const std::function<void(const char*, size_t)>& dispatch)
+    {
+        if(mFraming == nullptr)
+        {
+            if(buffer.size() > 0)
+                dispatch(buffer.data(), buffer.size());
+            buffer.clear();
+            return true;
+        }
+
+        return mFraming->decodeAll(buffer, scanned, dispatch);
+    }
+
+
+    void SocketAdapter::deliverBatch(std::vector<std::string_view>& batch, int type, uint64 handle)
+    {
+        if(batch.empty())
+            return;
+
+        SocketEvent event(type, handle);
+        event.mBatch = &batch;
+        deliver(std::move(event));
+        batch.clear();
+    }
+
+
+    const std::vector<std::string_view>& SocketAdapter::getEventBatch(const SocketEvent& event)
+    {
+        if(event.mBatch != nullptr)
+            return *event.mBatch;
+
+        // a queued batch holds the sizes of its messages followed by the messages
+        const char* sizes = event.mBuffer.data();
+        const char* data = sizes + event.mBatchCount * sizeof(uint32);
+        mDispatchedBatch.clear();
+        for(uint32 i = 0; i < event.mBatchCount; i++)
+        {
+            uint32 size;
+            std::memcpy(&size, sizes + i * sizeof(uint32), sizeof(uint32));
+            mDispatchedBatch.emplace_back(data, size);
+            data += size;
+        }
+        return mDispatchedBatch;
+    }
+
+
+    bool SocketAdapter::encodeFrame(size_t messageSize, SocketFrameEncoding& encoding)
+    {
+        if(mFraming == nullptr)
+        {
+            encoding.mHeaderSize = 0;
+            encoding.mTrailer = asio::const_buffer();
+            return true;
+        }
+
+        return mFraming->encode(messageSize, encoding);
+    }
+
+
+    asio::error_code SocketAdapter::checkReadable(SocketStreamProtocol::socket& socket)
+    {
+        asio::error_code err;
+        if(socket.available(err) > 0 || err)
+            return err;
+
+        // peek without blocking, receiving nothing means the remote end closed the connection
+        char peek;
+        bool non_blocking = socket.non_blocking();
+        socket.non_blocking(true, err);
+        if(err)
+            return err;
+
+        socket.receive(asio::buffer(&peek, 1), asio::socket_base::message_peek, err);
+
+        asio::error_code non_blocking_error;
+        socket.non_blocking(non_blocking, non_blocking_error);
+
+        // spurious wake up, data was already consumed
+        if(err == asio::error::would_block)
+            err.clear();
+
+        return err;
+    }
+
+
+    asio::error_code SocketAdapter::notifyPeer(SocketStreamProtocol::socket& socket)
+    {
+        static const char wake_up = 1;
+        asio::error_code err;
+        socket.send(asio::buffer(&wake_up, 1), 0, err);
+        if(err == asio::error::would_block)
+            err.clear();
+
+        return err;
+    }
+
+
+    bool SocketAdapter::createLocalEndpoint(const std::string& path, SocketStreamProtocol::endpoint& endpoint, utility::ErrorState& errorState)
+    {
+#ifdef ASIO_HAS_LOCAL_SOCKETS
+        if(!errorState.check(!path.empty(), "Local Path cannot be empty"))
+            return false;
+
+#if defined(__unix__) || defined(__APPLE__)
+        constexpr size_t max_path_size = sizeof(sockaddr_un::sun_path);
+#else
+        // sockaddr_un of afunix.h on Windows
+        constexpr size_t max_path_size = 108;
+#endif
+        if(!errorState.check(path.size() < max_path_size, "Local Path %s is too long", path.c_str()))
+            return false;
+
+        // abstract socket names start with a null byte
+        std::string socket_path = path;
+        if(isAbstractLocalPath(socket_path))
+            socket_path[0] = '\0';
+
+        endpoint = SocketStreamProtocol::endpoint(asio::local::stream_protocol::endpoint(socket_path));
+        return true;
+#else
+        errorState.fail("Local sockets are not supported on this platform");
+        return false;
+#endif
+    }
+
+
+    SocketQueueLimits SocketAdapter::getQueueLimits() const
+    {
+        SocketQueueLimits limits;
+        limits.mMaxMessages = mQueueMaxMessages;
+        limits.mMaxBytes = mQueueMaxBytes;
+        limits.mPolicy = mQueueOverflowPolicy;
+        limits.mBlockTimeoutMillis = mQueueBlockTimeoutMillis;
+        limits.mHighWatermarkBytes = mQueueHighWatermark;
+        limits.mLowWatermarkBytes = mQueueLowWatermark;
+        return limits;
+    }
+
+
+    bool SocketAdapter::canBlockSender(const asio::io_service& service) const
+    {
+        // the threads of the SocketThread drain the queues, blocking one of them could stall the queue it waits on
+        return isRunByOwnThread(service) && !mThread->isOwnThread();
+    }
+
+
     asio::io_service& SocketAdapter::getIOService()
     {
         return mThread->getIOService();
     }
+
+
+    asio::io_service& SocketAdapter::getWorkerIOService()
+    {
+        return mThread->getWorkerIOService();
+    }
+
+
+    bool SocketAdapter::isRunByOwnThread(const asio::io_service& service) const
+    {
+        return mThread->isRunByOwnThread(service);
+    }
+
+
+    void SocketAdapter::waitForHandlers()
+    {
+        mThread->waitForHandlers();
+    }
+
+
+    void SocketAdapter::requestProcess()
+    {
+        mThread->requestProcess(this);
+    }
+
+
+    bool SocketAdapter::isEventDriven() const
+    {
+        return mThread->mUpdateMethod == ESocketThreadUpdateMethod::EVENT_DRIVEN;
+    }
+
+
+    void SocketAdapter::deliver(SocketEvent&& event)
+    {
+        if(!isDeliveredOnMainThread())
+        {
+            auto lock = lockSignals();
+            triggerEvent(event);
+            return;
+        }
+
+        // the data is only valid during this call, the main thread gets a pooled copy
+        if(event.mBatch != nullptr)
+        {
+            size_t total_size = event.mBatch->size() * sizeof(uint32);
+            for(const auto& message : *event.mBatch)
+                total_size += message.size();
+
+            event.mBuffer = SocketBuffer(total_size);
+            char* sizes = event.mBuffer.data();
+            char* data = sizes + event.mBatch->size() * sizeof(uint32);
+            for(const auto& message : *event.mBatch)
+            {
+                auto size = static_cast<uint32>(message.size());
+                std::memcpy(sizes, &size, sizeof(uint32));
+                std::memcpy(data, message.data(), message.size());
+                sizes += sizeof(uint32);
+                data += message.size();
+            }
+            event.mBatchCount = static_cast<uint32>(event.mBatch->size());
+            event.mBatch = nullptr;
+        }
+        else if(event.mSize > 0)
+        {
+            event.mBuffer = SocketBuffer(event.mSize);
+            std::memcpy(event.mBuffer.data(), event.mData, event.mSize);
+            event.mData = event.mBuffer.data();
+        }
+
+        event.mSequence = mNextEventSequence.fetch_add(1);
+        mEvents.enqueue(std::move(event));
+    }
+
+
+    std::unique_lock<std::recursive_mutex> SocketAdapter::lockSignals()
+    {
+        if(mThread->mWorkerCount > 0)
+            return std::unique_lock<std::recursive_mutex>(mSignalMutex);
+
+        return std::unique_lock<std::recursive_mutex>(mSignalMutex, std::defer_lock);
+    }
+
+
+    void SocketAdapter::dispatchEvents()
+    {
+        // events queued by the signals themselves are dispatched on the next update
+        size_t remaining = mEvents.size_approx();
+        while(remaining > 0)
+        {
+            size_t pending = mPendingEvents.size();
+            mPendingEvents.resize(pending + std::min<size_t>(remaining, 64));
+            size_t count = mEvents.try_dequeue_bulk(mPendingEvents.begin() + pending, mPendingEvents.size() - pending);
+            mPendingEvents.resize(pending + count);
+            if(count == 0)
+                break;
+
+            remaining -= std::min(remaining, count);
+        }
+
+        // the queue only keeps the events of a single thread in order, restore the order they were delivered in
+        auto by_sequence = [](const SocketEvent& a, const SocketEvent& b) { return a.mSequence < b.mSequence; };
+        if(!std::is_sorted(mPendingEvents.begin(), mPendingEvents.end(), by_sequence))
+            std::sort(mPendingEvents.begin(), mPendingEvents.end(), by_sequence);
+
+        // an event that is still being queued by another thread holds back the events after it until the next update
+        size_t dispatched = 0;
+        while(dispatched < mPendingEvents.size() && mPendingEvents[dispatched].mSequence == mNextDispatchSequence)
+        {
+            triggerEvent(mPendingEvents[dispatched]);
+            mNextDispatchSequence++;
+            dispatched++;
+        }
+        mPendingEvents.erase(mPendingEvents.begin(), mPendingEvents.begin() + dispatched);
+    }
 }
@@ -7,20 +7,83 @@
 // Nap includes
 #include <nap/resourceptr.h>
 #include <socketthread.h>
+#include <socketframing.h>
+#include <socketsendqueue.h>
+#include <socketmetrics.h>
+#include <socketbufferpool.h>
+#include <functional>
+#include <mutex>
+#include <string_view>
+#include <vector>
 
 // ASIO includes
 #include <asio/ts/buffer.hpp>
 #include <asio/ts/internet.hpp>
 #include <asio/io_service.hpp>
 #include <asio/system_error.hpp>
+#include <asio/basic_socket_acceptor.hpp>
+#include <asio/generic/stream_protocol.hpp>
+#include <asio/local/stream_protocol.hpp>
 
 namespace nap
 {
 	//////////////////////////////////////////////////////////////////////////
 
+	/**
+	 * Transport used by stream sockets
+	 */
+	enum class ESocketTransport : int
+	{
+		TCP			= 0,	///< TCP/IP, addressed by ip address and port
+		LOCAL		= 1,	///< local stream socket (AF_UNIX) for peers on the same host, addressed by a path
+		SHARED_MEMORY	= 2		///< shared memory rings for peers on the same host, set up over a local stream socket addressed by a path
+	};
+
+	/**
+	 * Thread the signals of an adapter are triggered on
+	 */
+	enum class ESocketSignalDelivery : int
+	{
+		SOCKET_THREAD	= 0,	///< signals are triggered on the thread handling the socket as soon as the event occurs
+		MAIN_THREAD		= 1		///< events are queued and their signals are triggered in batch by SocketService::update() on the main thread
+	};
+
+	/**
+	 * Event of a SocketAdapter, triggers its signals on the socket thread or, queued, on the main thread. The adapter
+	 * defines the event types and how the fields are used. The data of a queued event is a pooled copy, the data of an
+	 * event triggered on the socket thread refers to the receive buffer and is only valid while it is triggered
+	 */
+	struct SocketEvent
+	{
+		SocketEvent() = default;
+		SocketEvent(int type, uint64 handle, const char* data = nullptr, size_t size = 0) :
+			mType(type), mHandle(handle), mData(data), mSize(size)				{ }
+
+		int										mType = 0;				///< adapter specific event type
+		uint64									mHandle = 0;			///< connection the event refers to
+		bool									mValue = false;			///< adapter specific flag, for example the writable state
+		const char*								mData = nullptr;		///< message, or label of the connection
+		size_t									mSize = 0;				///< size of the data in bytes
+		const std::vector<std::string_view>*	mBatch = nullptr;		///< messages of a batch event, see SocketAdapter::getEventBatch()
+		uint32									mBatchCount = 0;		///< number of messages of a queued batch event
+		uint64									mSequence = 0;			///< order in which queued events are dispatched
+		SocketBuffer							mBuffer;				///< pooled copy of the data of a queued event
+	};
+
+	/**
+	 * Protocol of the stream sockets of SocketClient and SocketServer, holds either a TCP or a local stream socket
+	 */
+	using SocketStreamProtocol = asio::generic::stream_protocol;
+
+	/**
+	 * Acceptor of SocketServer, accepts TCP or local stream connections
+	 */
+	using SocketStreamAcceptor = asio::basic_socket_acceptor<SocketStreamProtocol>;
+
 	class NAPAPI SocketAdapter : public Resource
 	{
 		friend class SocketThread;
+		friend class SocketService;
 
 		RTTI_ENABLE(Resource)
 	public:
@@ -37,18 +100,238 @@ namespace nap
 		 * called on destruction
 		 */
 		virtual void onDestroy() override;
+
+        /**
+         * Returns the counters, queue depth and latency histograms of this adapter, only recorded when 'Enable Metrics'
+         * is set. Thread-safe
+         * @return snapshot of the metrics
+         */
+        SocketMetricsSnapshot getMetrics() const;
+
+        /**
+         * Resets all counters and histograms. Thread-safe
+         */
+        void resetMetrics()                                         { mMetrics.reset(); }
     public:
         // Properties
         bool mAllowFailure 					= false; ///< Property: 'AllowFailure' if binding to socket is allowed to fail on initialization
 	    bool mNoDelay                       = true;   ///< Property: 'No Delay' disables Nagle algorithm
+        ResourcePtr<SocketFraming> mFraming = nullptr; ///< Property: 'Framing' optional codec splitting the received stream into messages and framing sent messages
+        bool mCopyReceivedMessages          = true;  ///< Property: 'Copy Received Messages' whether received messages are copied into a std::string for the string based receive signals, disable when only the view based signals are used
+        bool mBatchReceivedMessages         = false; ///< Property: 'Batch Received Messages' whether received messages are delivered as one batch per receive pass through the batch receive signal instead of the per-message signals
+        int mQueueMaxMessages               = 0;     ///< Property: 'Queue Max Messages' maximum number of messages queued for sending per socket, 0 is unlimited
+        int mQueueMaxBytes                  = 0;     ///< Property: 'Queue Max Bytes' maximum number of payload bytes queued for sending per socket, 0 is unlimited
+        ESocketQueueOverflowPolicy mQueueOverflowPolicy = ESocketQueueOverflowPolicy::DROP_OLDEST; ///< Property: 'Queue Overflow Policy' what happens when a message is sent to a full queue
+        int mQueueBlockTimeoutMillis        = 100;   ///< Property: 'Queue Block Timeout' maximum time in milliseconds a sender blocks with the BLOCK overflow policy
+        int mQueueHighWatermark             = 0;     ///< Property: 'Queue High Watermark' a socket becomes unwritable when more bytes are queued, 0 disables the writable state
+        int mQueueLowWatermark              = 0;     ///< Property: 'Queue Low Watermark' an unwritable socket becomes writable again when its queue drains to this many bytes
+        bool mEnableMetrics                 = false; ///< Property: 'Enable Metrics' whether message counters and latency histograms are recorded, see getMetrics()
+        ESocketSignalDelivery mSignalDelivery = ESocketSignalDelivery::SOCKET_THREAD; ///< Property: 'Signal Delivery' whether connection and message signals are triggered on the socket thread or on the main thread
     protected:
 		/**
 		 * called by a SocketThread
 		 */
 		virtual void process() = 0;
 
+        /**
+         * Returns the number of messages and bytes waiting to be sent, summed over all sockets of the adapter
+         * @return the total queue depth, empty by default
+         */
+        virtual SocketQueueDepth getTotalQueueDepth() const         { return {}; }
+
+        /**
+         * @return the metrics to record to, nullptr when 'Enable Metrics' is not set
+         */
+        SocketMetrics* getEnabledMetrics()                          { return mEnableMetrics ? &mMetrics : nullptr; }
+
+        /**
+         * Records a message handed to the kernel when metrics are enabled
+         * @param message the sent message
+         */
+        void recordSent(const SocketQueuedMessage& message)         { if(mEnableMetrics) mMetrics.recordSent(message.mPayload.size(), message.mEnqueueTime); }
+
+        /**
+         * Records a dispatched message when metrics are enabled
+         * @param size size of the message in bytes
+         */
+        void recordReceived(size_t size)                            { if(mEnableMetrics) mMetrics.recordReceived(size); }
+
         bool handleAsioError(const asio::error_code& errorCode, utility::ErrorState& errorState, bool& success);
 
+        /**
+         * Dispatches all complete messages in the receive buffer and consumes them.
+         * Without framing all received data is dispatched as a single message
+         * @param buffer the receive buffer
+         * @param scanned scan state of the framing codec, see SocketFraming::decode()
+         * @param dispatch function called for every message, the data is only valid for the duration of the call
+         * @return false when the received data can not be decoded
+         */
+        bool dispatchMessages(SocketReceiveBuffer& buffer, size_t& scanned, const std::function<void(const char*, size_t)>& dispatch);
+
+        /**
+         * Adds a received message to the batch when 'Batch Received Messages' is enabled
+         * @param batch the batch of the current receive pass
+         * @param data pointer to the message, must stay valid until the batch is delivered
+         * @param size size of the message in bytes
+         * @return true if the message was batched and the per-message signals must be skipped
+         */
+        bool batchMessage(std::vector<std::string_view>& batch, const char* data, size_t size)
+        {
+            if(!mBatchReceivedMessages)
+                return false;
+            batch.emplace_back(data, size);
+            return true;
+        }
+
+        /**
+         * Delivers a batch event holding all messages of a receive pass and clears the batch. When signals are
+         * delivered on the main thread the messages are copied into a single pooled block first
+         * @param batch the batch of the current receive pass, does nothing when empty
+         * @param type adapter specific type of the batch event
+         * @param handle connection the batch was received on
+         */
+        void deliverBatch(std::vector<std::string_view>& batch, int type, uint64 handle);
+
+        /**
+         * Returns the messages of a batch event, see deliverBatch()
+         * @param event the batch event being triggered
+         * @return views of the messages, valid while the event is triggered
+         */
+        const std::vector<std::string_view>& getEventBatch(const SocketEvent& event);
+
+        /**
+         * Creates the header and trailer to write around an outgoing message. Without framing both are empty
+         * @param messageSize size of the message in bytes
+         * @param encoding the header and trailer
+         * @return false when the message can not be framed
+         */
+        bool encodeFrame(size_t messageSize, SocketFrameEncoding& encoding);
+
+        /**
+         * Checks a socket that signalled it is readable. A readable socket without available bytes is either a
+         * spurious wake up or closed by the remote end, which is tested with a non-blocking peek. Only needed after a
+         * readiness wait like the one of SocketClient, asynchronous reads report a closed connection themselves
+         * @param socket the readable socket
+         * @return asio::error::eof when the remote end closed the connection, empty when the socket is still usable
+         */
+        asio::error_code checkReadable(SocketStreamProtocol::socket& socket);
+
+        /**
+         * Wakes up the peer of a shared memory channel by sending a single byte over the socket that set up the channel,
+         * see SocketSharedChannel. The socket must be non-blocking, a full socket buffer already holds wake ups for the
+         * peer and is not an error
+         * @param socket the socket connected to the peer
+         * @return error that occurred while sending
+         */
+        asio::error_code notifyPeer(SocketStreamProtocol::socket& socket);
+
+        /**
+         * Creates the endpoint of a local stream socket. A path starting with '@' refers to the Linux abstract namespace,
+         * which has no file system entry
+         * @param path the socket path
+         * @param endpoint the created endpoint
+         * @param errorState contains the error when the path is invalid or local sockets are not supported
+         * @return true on success
+         */
+        static bool createLocalEndpoint(const std::string& path, SocketStreamProtocol::endpoint& endpoint, utility::ErrorState& errorState);
+
+        /**
+         * @return whether the path refers to a local socket in the Linux abstract namespace
+         */
+        static bool isAbstractLocalPath(const std::string& path)    { return !path.empty() && path[0] == '@'; }
+
+        /**
+         * @return the outgoing queue limits configured on this adapter
+         */
+        SocketQueueLimits getQueueLimits() const;
+
+        /**
+         * Returns whether the calling thread may block until a socket handled by the given asio::io_service drains its
+         * outgoing queue. Blocking is only allowed when the io_service is run by a thread owned by the SocketThread,
+         * and the calling thread is not owned by the SocketThread itself
+         * @param service the asio::io_service handling the socket
+         * @return whether the sender may block
+         */
+        bool canBlockSender(const asio::io_service& service) const;
+
         asio::io_service& getIOService();
+
+        /**
+         * Returns the next worker asio::io_service of the SocketThread, see SocketThread 'Worker Count'.
+         * Returns the asio::io_service of the SocketThread when no workers are configured
+         * @return reference to worker asio::io_service
+         */
+        asio::io_service& getWorkerIOService();
+
+        /**
+         * Returns whether the given asio::io_service is run by a thread owned by the SocketThread, being a worker or
+         * the thread spawned when the update method is SPAWN_OWN_THREAD or EVENT_DRIVEN
+         * @param service the asio::io_service to check
+         * @return whether the asio::io_service is run by a thread owned by the SocketThread
+         */
+        bool isRunByOwnThread(const asio::io_service& service) const;
+
+        /**
+         * Blocks until all handlers posted before this call have completed on the asio::io_services that are run by
+         * threads owned by the SocketThread, see isRunByOwnThread()
+         */
+        void waitForHandlers();
+
+        /**
+         * Requests the SocketThread to call process() on this adapter as soon as possible.
+         * Only has effect when the thread update method is EVENT_DRIVEN, other update methods call process() continuously.
+         * Thread-safe
+         */
+        void requestProcess();
+
+        /**
+         * @return whether the SocketThread this adapter is registered to runs in EVENT_DRIVEN mode
+         */
+        bool isEventDriven() const;
+
+        /**
+         * @return whether signals are triggered on the main thread, see 'Signal Delivery'
+         */
+        bool isDeliveredOnMainThread() const                        { return mSignalDelivery == ESocketSignalDelivery::MAIN_THREAD; }
+
+        /**
+         * Serializes triggering signals on the socket threads. Only locks when the SocketThread has workers, which
+         * handle their sockets in parallel. The lock is recursive, slots may cause other signals of the adapter
+         * @return the lock, holding the signal mutex when the SocketThread has workers
+         */
+        std::unique_lock<std::recursive_mutex> lockSignals();
+
+        /**
+         * Triggers the signals of an event, see triggerEvent(). The event is triggered right away, or queued with a
+         * pooled copy of its data and triggered by SocketService::update() when signals are delivered on the main
+         * thread. Queued events are triggered in the order they were delivered in, also when delivered by different
+         * threads. Thread-safe
+         * @param event the event
+         */
+        void deliver(SocketEvent&& event);
+
+        /**
+         * Triggers the signals of an event delivered by this adapter, see deliver()
+         * @param event the event
+         */
+        virtual void triggerEvent(const SocketEvent& event)         { }
+    private:
+        /**
+         * Calls the events queued before this call, called by SocketService::update() on the main thread
+         */
+        void dispatchEvents();
+
+        std::atomic_bool mProcessRequested = { false };
+        std::atomic<uint64> mRegistrationID = { 0 };   ///< set by the SocketThread on registration, 0 when not registered
+        std::recursive_mutex mSignalMutex;
+        bool mRegistered = false;                       ///< whether init() registered the adapter to the SocketThread
+        SocketMetrics mMetrics;
+
+        // events waiting for the main thread, dequeued per producing thread and put back in order by their sequence
+        moodycamel::ConcurrentQueue<SocketEvent>            mEvents;
+        std::atomic<uint64>                                 mNextEventSequence = { 0 };
+        uint64                                              mNextDispatchSequence = 0;
+        std::vector<SocketEvent>                            mPendingEvents;     ///< dequeued events waiting for an event queued before them
+        std::vector<std::string_view>                       mDispatchedBatch;   ///< views of the batch delivered on the main thread
 	};
 }
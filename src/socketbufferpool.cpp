@@ -0,0 +1,244 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#include "socketbufferpool.h"
+
+// External includes
+#include <algorithm>
+#include <cassert>
+
+namespace nap
+{
+    //////////////////////////////////////////////////////////////////////////
+    // SocketBufferThreadCache
+    //////////////////////////////////////////////////////////////////////////
+
+    /**
+     * Free blocks cached by a single thread, handed back to the shared free lists when the thread exits
+     */
+    struct SocketBufferThreadCache
+    {
+        // number of bytes a thread caches per size class, at least 2 blocks
+        static constexpr size_t sMaxCachedBytes = 256 * 1024;
+
+        ~SocketBufferThreadCache()
+        {
+            auto& pool = SocketBufferPool::get();
+            for(size_t i = 0; i < SocketBufferPool::sClassCount; i++)
+                pool.pushShared(i, mBlocks[i].data(), mBlocks[i].size());
+        }
+
+        static size_t getMaxBlocks(size_t sizeClass)
+        {
+            return std::max<size_t>(2, sMaxCachedBytes / SocketBufferPool::getClassBlockSize(sizeClass));
+        }
+
+        std::array<std::vector<char*>, SocketBufferPool::sClassCount> mBlocks;
+    };
+
+
+    static thread_local SocketBufferThreadCache sThreadCache;
+
+
+    //////////////////////////////////////////////////////////////////////////
+    // SocketBufferPool
+    //////////////////////////////////////////////////////////////////////////
+
+    SocketBufferPool& SocketBufferPool::get()
+    {
+        // intentionally leaked, thread caches return their blocks on thread exit which may be after static destruction
+        static auto* pool = new SocketBufferPool();
+        return *pool;
+    }
+
+
+    size_t SocketBufferPool::getSizeClass(size_t size)
+    {
+        size_t size_class = 0;
+        size_t block_size = sMinBlockSize;
+        while(block_size < size && size_class < sClassCount)
+        {
+            block_size <<= 1;
+            size_class++;
+        }
+        return size_class;
+    }
+
+
+    char* SocketBufferPool::acquire(size_t size, size_t& capacity)
+    {
+        size_t size_class = getSizeClass(size);
+
+        // too large to pool
+        if(size_class == sClassCount)
+        {
+            mMisses.fetch_add(1, std::memory_order_relaxed);
+            capacity = size;
+            addInUse(static_cast<int64>(capacity));
+            return new char[capacity];
+        }
+
+        capacity = getClassBlockSize(size_class);
+        addInUse(static_cast<int64>(capacity));
+
+        // thread cache first, then the shared free list
+        auto& cached = sThreadCache.mBlocks[size_class];
+        char* block = nullptr;
+        if(!cached.empty())
+        {
+            block = cached.back();
+            cached.pop_back();
+        }else
+        {
+            block = popShared(size_class);
+        }
+
+        if(block != nullptr)
+        {
+            mHits.fetch_add(1, std::memory_order_relaxed);
+            return block;
+        }
+
+        mMisses.fetch_add(1, std::memory_order_relaxed);
+        return new char[capacity];
+    }
+
+
+    void SocketBufferPool::release(char* block, size_t capacity)
+    {
+        if(block == nullptr)
+            return;
+
+        addInUse(-static_cast<int64>(capacity));
+
+        size_t size_class = getSizeClass(capacity);
+        if(size_class == sClassCount)
+        {
+            delete[] block;
+            return;
+        }
+
+        assert(getClassBlockSize(size_class) == capacity);
+
+        // hand half of a full thread cache to the shared free list, blocks released by another thread than the one
+        // acquiring them would otherwise pile up
+        auto& cached = sThreadCache.mBlocks[size_class];
+        size_t max_blocks = SocketBufferThreadCache::getMaxBlocks(size_class);
+        if(cached.size() >= max_blocks)
+        {
+            size_t keep = max_blocks / 2;
+            pushShared(size_class, cached.data() + keep, cached.size() - keep);
+            cached.resize(keep);
+        }
+        cached.emplace_back(block);
+    }
+
+
+    char* SocketBufferPool::popShared(size_t sizeClass)
+    {
+        auto& size_class = mClasses[sizeClass];
+        std::lock_guard lock(size_class.mMutex);
+        if(size_class.mFreeBlocks.empty())
+            return nullptr;
+
+        char* block = size_class.mFreeBlocks.back();
+        size_class.mFreeBlocks.pop_back();
+        mCachedBytes.fetch_sub(static_cast<int64>(getClassBlockSize(sizeClass)), std::memory_order_relaxed);
+        return block;
+    }
+
+
+    void SocketBufferPool::pushShared(size_t sizeClass, char* const* blocks, size_t count)
+    {
+        if(count == 0)
+            return;
+
+        auto& size_class = mClasses[sizeClass];
+        std::lock_guard lock(size_class.mMutex);
+        size_class.mFreeBlocks.insert(size_class.mFreeBlocks.end(), blocks, blocks + count);
+        mCachedBytes.fetch_add(static_cast<int64>(getClassBlockSize(sizeClass) * count), std::memory_order_relaxed);
+    }
+
+
+    void SocketBufferPool::trim()
+    {
+        for(size_t i = 0; i < sClassCount; i++)
+        {
+            std::vector<char*> blocks;
+            {
+                std::lock_guard lock(mClasses[i].mMutex);
+                std::swap(blocks, mClasses[i].mFreeBlocks);
+                mCachedBytes.fetch_sub(static_cast<int64>(getClassBlockSize(i) * blocks.size()), std::memory_order_relaxed);
+            }
+
+            for(auto* block : blocks)
+                delete[] block;
+        }
+    }
+
+
+    void SocketBufferPool::addInUse(int64 bytes)
+    {
+        int64 in_use = mInUseBytes.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+        int64 peak = mPeakInUseBytes.load(std::memory_order_relaxed);
+        while(in_use > peak && !mPeakInUseBytes.compare_exchange_weak(peak, in_use, std::memory_order_relaxed)){}
+    }
+
+
+    SocketBufferPoolStats SocketBufferPool::getStats() const
+    {
+        SocketBufferPoolStats stats;
+        stats.mHits = mHits.load(std::memory_order_relaxed);
+        stats.mMisses = mMisses.load(std::memory_order_relaxed);
+        stats.mInUseBytes = static_cast<uint64>(std::max<int64>(0, mInUseBytes.load(std::memory_order_relaxed)));
+        stats.mPeakInUseBytes = static_cast<uint64>(mPeakInUseBytes.load(std::memory_order_relaxed));
+        stats.mCachedBytes = static_cast<uint64>(std::max<int64>(0, mCachedBytes.load(std::memory_order_relaxed)));
+        return stats;
+    }
+
+
+    //////////////////////////////////////////////////////////////////////////
+    // SocketBuffer
+    //////////////////////////////////////////////////////////////////////////
+
+    SocketBuffer::SocketBuffer(size_t size)
+    {
+        mData = SocketBufferPool::get().acquire(size, mCapacity);
+    }
+
+
+    SocketBuffer::~SocketBuffer()
+    {
+        reset();
+    }
+
+
+    SocketBuffer::SocketBuffer(SocketBuffer&& other) noexcept :
+        mData(other.mData),
+        mCapacity(other.mCapacity)
+    {
+        other.mData = nullptr;
+        other.mCapacity = 0;
+    }
+
+
+    SocketBuffer& SocketBuffer::operator=(SocketBuffer&& other) noexcept
+    {
+        if(this != &other)
+        {
+            reset();
+            std::swap(mData, other.mData);
+            std::swap(mCapacity, other.mCapacity);
+        }
+        return *this;
+    }
+
+
+    void SocketBuffer::reset()
+    {
+        SocketBufferPool::get().release(mData, mCapacity);
+        mData = nullptr;
+        mCapacity = 0;
+    }
+}
@@ -0,0 +1,170 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#pragma once
+
+// External includes
+#include <nap/numeric.h>
+#include <array>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+namespace nap
+{
+    //////////////////////////////////////////////////////////////////////////
+
+    /**
+     * Snapshot of the SocketBufferPool counters
+     */
+    struct NAPAPI SocketBufferPoolStats
+    {
+        uint64 mHits            = 0;    ///< number of blocks served from a cache
+        uint64 mMisses          = 0;    ///< number of blocks allocated from the heap
+        uint64 mInUseBytes      = 0;    ///< number of bytes currently handed out
+        uint64 mPeakInUseBytes  = 0;    ///< highest number of bytes handed out at once
+        uint64 mCachedBytes     = 0;    ///< number of bytes held by the shared free lists, excluding thread-local caches
+    };
+
+
+    /**
+     * Module-wide pool of receive and send buffers. Blocks are grouped in power of two size classes from 256 bytes up
+     * to 1 MB. Every thread keeps a small cache of free blocks per size class, so the socket threads and workers can
+     * acquire and release blocks without locking. Threads fall back on a shared free list per size class, and only
+     * allocate from the heap when that list is empty too. Requests larger than the largest size class are allocated
+     * and freed directly.
+     */
+    class NAPAPI SocketBufferPool final
+    {
+    public:
+        static constexpr size_t sMinBlockSize   = 256;
+        static constexpr size_t sMaxBlockSize   = 1024 * 1024;
+        static constexpr size_t sClassCount     = 13;
+
+        /**
+         * Returns the pool, the pool is never destroyed so blocks can be released at any time, also from thread exit
+         * @return the module-wide buffer pool
+         */
+        static SocketBufferPool& get();
+
+        /**
+         * Acquires a block of at least the given size. Thread-safe
+         * @param size minimum size in bytes
+         * @param capacity the actual size of the block, pass it to release()
+         * @return the block
+         */
+        char* acquire(size_t size, size_t& capacity);
+
+        /**
+         * Returns a block to the pool. Thread-safe
+         * @param block block returned by acquire()
+         * @param capacity capacity returned by acquire()
+         */
+        void release(char* block, size_t capacity);
+
+        /**
+         * Frees all blocks in the shared free lists, blocks cached by threads are kept. Thread-safe
+         */
+        void trim();
+
+        /**
+         * @return snapshot of the pool counters. Thread-safe
+         */
+        SocketBufferPoolStats getStats() const;
+
+        /**
+         * Returns the size class a block of the given size is served from
+         * @param size size in bytes
+         * @return the size class, sClassCount when the size exceeds sMaxBlockSize
+         */
+        static size_t getSizeClass(size_t size);
+
+        /**
+         * @param sizeClass the size class
+         * @return size in bytes of blocks in the size class
+         */
+        static size_t getClassBlockSize(size_t sizeClass)  { return sMinBlockSize << sizeClass; }
+    private:
+        friend struct SocketBufferThreadCache;
+
+        SocketBufferPool() = default;
+
+        /**
+         * Pops a block of the size class from the shared free list, nullptr when empty
+         */
+        char* popShared(size_t sizeClass);
+
+        /**
+         * Pushes blocks of the size class to the shared free list
+         */
+        void pushShared(size_t sizeClass, char* const* blocks, size_t count);
+
+        /**
+         * Updates the in use counters after a block is handed out or returned
+         */
+        void addInUse(int64 bytes);
+
+        struct SizeClass
+        {
+            std::mutex              mMutex;
+            std::vector<char*>      mFreeBlocks;
+        };
+
+        std::array<SizeClass, sClassCount>  mClasses;
+        std::atomic<uint64>                 mHits = { 0 };
+        std::atomic<uint64>                 mMisses = { 0 };
+        std::atomic<int64>                  mInUseBytes = { 0 };
+        std::atomic<int64>                  mPeakInUseBytes = { 0 };
+        std::atomic<int64>                  mCachedBytes = { 0 };
+    };
+
+
+    /**
+     * Move-only handle to a block of the SocketBufferPool, the block is returned to the pool on destruction
+     */
+    class NAPAPI SocketBuffer final
+    {
+    public:
+        /**
+         * Creates an empty buffer that holds no block
+         */
+        SocketBuffer() = default;
+
+        /**
+         * Acquires a block of at least the given size from the pool
+         * @param size minimum size in bytes
+         */
+        explicit SocketBuffer(size_t size);
+
+        ~SocketBuffer();
+
+        SocketBuffer(SocketBuffer&& other) noexcept;
+        SocketBuffer& operator=(SocketBuffer&& other) noexcept;
+        SocketBuffer(const SocketBuffer&) = delete;
+        SocketBuffer& operator=(const SocketBuffer&) = delete;
+
+        /**
+         * Returns the block to the pool, the buffer is empty afterwards
+         */
+        void reset();
+
+        /**
+         * @return pointer to the block, nullptr when empty
+         */
+        char* data()                        { return mData; }
+
+        /**
+         * @return pointer to the block, nullptr when empty
+         */
+        const char* data() const            { return mData; }
+
+        /**
+         * @return size of the block in bytes
+         */
+        size_t capacity() const             { return mCapacity; }
+    private:
+        char*   mData = nullptr;
+        size_t  mCapacity = 0;
+    };
+}
@@ -12,6 +12,7 @@
 #include <asio/system_error.hpp>
 #include <nap/logger.h>
 
+#include <cmath>
 #include <thread>
 
 using asio::ip::address;
@@ -21,13 +22,22 @@ using asio::buffers_begin;
 RTTI_BEGIN_CLASS(nap::SocketClient)
 	RTTI_PROPERTY("Endpoint",					&nap::SocketClient::mRemoteIp,						nap::rtti::EPropertyMetaData::Default)
 	RTTI_PROPERTY("Port",						&nap::SocketClient::mPort,							nap::rtti::EPropertyMetaData::Default)
+    RTTI_PROPERTY("Transport",                  &nap::SocketClient::mTransport,                     nap::rtti::EPropertyMetaData::Default)
+    RTTI_PROPERTY("Local Path",                 &nap::SocketClient::mLocalPath,                     nap::rtti::EPropertyMetaData::Default)
+    RTTI_PROPERTY("Shared Memory Size",         &nap::SocketClient::mSharedMemorySize,              nap::rtti::EPropertyMetaData::Default)
     RTTI_PROPERTY("Connect on init",            &nap::SocketClient::mConnectOnInit,                 nap::rtti::EPropertyMetaData::Default)
     RTTI_PROPERTY("Reconnect On Disconnect",    &nap::SocketClient::mEnableAutoReconnect,           nap::rtti::EPropertyMetaData::Default)
     RTTI_PROPERTY("Reconnect Interval",         &nap::SocketClient::mAutoReconnectIntervalMillis,   nap::rtti::EPropertyMetaData::Default)
+    RTTI_PROPERTY("Reconnect Max Interval",     &nap::SocketClient::mAutoReconnectMaxIntervalMillis, nap::rtti::EPropertyMetaData::Default)
+    RTTI_PROPERTY("Reconnect Backoff",          &nap::SocketClient::mAutoReconnectBackoff,          nap::rtti::EPropertyMetaData::Default)
+    RTTI_PROPERTY("Reconnect Jitter",           &nap::SocketClient::mAutoReconnectJitter,           nap::rtti::EPropertyMetaData::Default)
+    RTTI_PROPERTY("Reconnect Immediately",      &nap::SocketClient::mReconnectImmediately,          nap::rtti::EPropertyMetaData::Default)
     RTTI_PROPERTY("Connect Timeout",            &nap::SocketClient::mConnectTimeOutMillis,          nap::rtti::EPropertyMetaData::Default)
     RTTI_PROPERTY("Enable Log",                 &nap::SocketClient::mEnableLog,                     nap::rtti::EPropertyMetaData::Default)
     RTTI_PROPERTY("Write Timeout",              &nap::SocketClient::mWriteTimeOutMillis,            nap::rtti::EPropertyMetaData::Default)
     RTTI_PROPERTY("Read Timeout",               &nap::SocketClient::mReadTimeOutMillis,             nap::rtti::EPropertyMetaData::Default)
+    RTTI_PROPERTY("Write Batch Messages",       &nap::SocketClient::mWriteBatchMaxMessages,         nap::rtti::EPropertyMetaData::Default)
+    RTTI_PROPERTY("Write Batch Bytes",          &nap::SocketClient::mWriteBatchMaxBytes,            nap::rtti::EPropertyMetaData::Default)
 RTTI_END_CLASS
 
 namespace nap
@@ -42,16 +52,57 @@ namespace nap
         bool init_success = false;
         asio::error_code asio_error_code;
 
-        // create address from string
-        auto address = address::from_string(mRemoteIp, asio_error_code);
-        if(handleAsioError(asio_error_code, errorState, init_success))
-            return init_success;
+        // validate write batch budget
+        if(!errorState.check(mWriteBatchMaxMessages > 0 && mWriteBatchMaxBytes > 0, "Write batch budget must be larger than 0"))
+            return false;
+
+        // validate reconnect policy
+        if(!errorState.check(mAutoReconnectBackoff >= 1.0f, "Reconnect Backoff must be at least 1"))
+            return false;
+
+        if(!errorState.check(mAutoReconnectJitter >= 0.0f && mAutoReconnectJitter <= 1.0f, "Reconnect Jitter must be between 0 and 1"))
+            return false;
+
+        // every client randomizes its reconnects differently
+        mReconnectRandom.seed(std::random_device()());
 
         // create endpoint
-        mRemoteEndpoint = std::make_unique<tcp::endpoint>(address, mPort);
+        mRemoteEndpoint = std::make_unique<SocketStreamProtocol::endpoint>();
+        if(mTransport != ESocketTransport::TCP)
+        {
+            if(!createLocalEndpoint(mLocalPath, *mRemoteEndpoint, errorState))
+                return false;
+        }else
+        {
+            // create address from string
+            auto address = address::from_string(mRemoteIp, asio_error_code);
+            if(handleAsioError(asio_error_code, errorState, init_success))
+                return init_success;
+
+            *mRemoteEndpoint = tcp::endpoint(address, mPort);
+        }
+
+        // create socket, it is opened with the protocol of the endpoint on connect
+        mSocket = std::make_unique<SocketStreamProtocol::socket>(getIOService());
 
-        // create socket
-        mSocket = std::make_unique<tcp::socket>(getIOService());
+        // timeouts and reconnects expire on the thread handling the client
+        mReconnectTimer.mTimer = std::make_unique<asio::steady_timer>(getIOService());
+        mConnectTimer.mTimer = std::make_unique<asio::steady_timer>(getIOService());
+        mWriteTimer.mTimer = std::make_unique<asio::steady_timer>(getIOService());
+        mReadTimer.mTimer = std::make_unique<asio::steady_timer>(getIOService());
+
+        // bound the outgoing queue, writable state changes are signalled on the thread processing the client
+        mQueue.setLimits(getQueueLimits());
+        mQueue.setMetrics(getEnabledMetrics());
+        mQueue.setWritabilityCallback([this](bool writable)
+        {
+            enqueueAction([this, writable]()
+            {
+                SocketEvent event(static_cast<int>(EEvent::WRITABILITY_CHANGED), 0);
+                event.mValue = writable;
+                deliver(std::move(event));
+            });
+        });
 
 		// init SocketAdapter, registering the client to an SocketThread
 		if (!SocketAdapter::init(errorState))
@@ -67,15 +118,28 @@ namespace nap
 
     void SocketClient::connect()
     {
-        mActionQueue.enqueue([this]()
+        enqueueAction([this]()
         {
             // try to open socket
             if (!mConnecting.load()) {
                 mConnecting.store(true);
-                mTimeoutTimer.reset();
-                mTimeoutTimer.start();
+                startTimer(mConnectTimer, mConnectTimeOutMillis, [this]()
+                {
+                    // log error to console
+                    logError("Connect timeout occured!");
+
+                    // close socket, the connect handler is called with an error and starts the reconnection timer
+                    asio::error_code error_code;
+                    mSocket->close(error_code);
+                    if(error_code)
+                    {
+                        logError(error_code.message());
+                    }
+                });
 
                 logInfo("Connecting");
+                if(auto* metrics = getEnabledMetrics())
+                    metrics->recordConnectAttempt();
                 mSocket->async_connect(*mRemoteEndpoint.get(),
                                        [this](const asio::error_code &errorCode) { handleConnect(errorCode); });
             }
@@ -85,7 +149,7 @@ namespace nap
 
     void SocketClient::disconnect()
     {
-        mActionQueue.enqueue([this]()
+        enqueueAction([this]()
         {
             asio::error_code err;
             mSocket->shutdown(asio::socket_base::shutdown_both, err);
@@ -99,6 +163,7 @@ namespace nap
             {
                 logInfo(utility::stringFormat("error closing socket : %s", err.message().c_str()));
             }
+            closeSharedChannel();
 
             if(mConnecting.load())
             {
@@ -110,7 +175,13 @@ namespace nap
                 mSocketReady.store(false);
             }
 
-            disconnected.trigger();
+            clearQueue();
+            if(auto* metrics = getEnabledMetrics())
+                metrics->recordDisconnect();
+            deliver(SocketEvent(static_cast<int>(EEvent::DISCONNECTED), 0));
+
+            // if auto reconnect is enabled start the reconnection timer
+            scheduleReconnect();
         });
     }
 
@@ -119,24 +190,71 @@ namespace nap
 	{
         SocketAdapter::onDestroy();
 
+        // stop the timers and close the socket on the thread handling them, cancels pending operations
         mSocketReady.store(false);
-		asio::error_code err;
-		mSocket->shutdown(asio::socket_base::shutdown_both, err);
-		if (err)
-		{
-            logInfo(utility::stringFormat("error closing socket : %s", err.message().c_str()));
-		}
+        auto close = [this]()
+        {
+            stopTimer(mReconnectTimer);
+            stopTimer(mConnectTimer);
+            stopTimer(mWriteTimer);
+            stopTimer(mReadTimer);
+
+            asio::error_code err;
+            mSocket->shutdown(asio::socket_base::shutdown_both, err);
+            if (err)
+            {
+                logInfo(utility::stringFormat("error closing socket : %s", err.message().c_str()));
+            }
+            mSocket->close(err);
+        };
+
+        if(isRunByOwnThread(getIOService()))
+        {
+            asio::post(getIOService(), close);
+        }else
+        {
+            close();
+        }
+
+        // make sure no other thread is still handling the client
+        waitForHandlers();
 	}
 
 
 	void SocketClient::send(const std::string& message)
 	{
+        send(message, nullptr);
+	}
+
+
+    ESocketQueueResult SocketClient::send(const std::string& message, SocketSendCallback callback)
+    {
         // only queue messages if socket is ready
-        if(mSocketReady.load())
+        if(!mSocketReady.load())
         {
-            mQueue.enqueue(message);
+            if(callback != nullptr)
+                callback(asio::error::not_connected);
+            return ESocketQueueResult::DROPPED;
         }
-	}
+
+        auto result = mQueue.push({ SocketPayload(message), std::move(callback) }, canBlockSender(getIOService()));
+        switch(result)
+        {
+        case ESocketQueueResult::QUEUED:
+            requestProcess();
+            break;
+        case ESocketQueueResult::DROPPED:
+            break;
+        case ESocketQueueResult::DISCONNECT:
+            // the server doesn't keep up, drop the connection
+            enqueueAction([this]()
+            {
+                handleError(asio::error::no_buffer_space);
+            });
+            break;
+        }
+        return result;
+    }
 
 
     void SocketClient::handleConnect(const asio::error_code& errorCode)
@@ -145,7 +263,7 @@ namespace nap
         mConnecting.store(false);
 
         // stop timeout timer
-        mTimeoutTimer.stop();
+        stopTimer(mConnectTimer);
 
         bool error = errorCode.operator bool();
         asio::error_code error_code = errorCode;
@@ -155,8 +273,13 @@ namespace nap
         {
             // set socket options
 
-            // no delay
-            mSocket->set_option(tcp::no_delay(mNoDelay), error_code);
+            // no delay, local sockets don't buffer small writes
+            if(mTransport == ESocketTransport::TCP)
+                mSocket->set_option(tcp::no_delay(mNoDelay), error_code);
+
+            // messages go through shared memory, the socket only carries wake ups
+            if(!error_code && mTransport == ESocketTransport::SHARED_MEMORY)
+                error_code = openSharedChannel();
 
             if (error_code)
             {
@@ -167,15 +290,23 @@ namespace nap
                 mSocketReady.store(true);
 
                 logInfo("Socket connected");
+                if(auto* metrics = getEnabledMetrics())
+                    metrics->recordConnect();
 
-                // reconnect timer can be stopped
-                mReconnectTimer.stop();
+                // reconnect timer can be stopped, the next connection loss starts backing off from scratch
+                stopTimer(mReconnectTimer);
+                mReconnectAttempt = 0;
 
-                // message queue can be cleared
+                // message queue and receive buffer can be cleared
                 clearQueue();
+                mReceiveBuffer.clear();
+                mReceiveScanned = 0;
 
                 // trigger connected signal
-                connected.trigger();
+                deliver(SocketEvent(static_cast<int>(EEvent::CONNECTED), 0));
+
+                // wait for incoming data when event driven
+                waitForData();
             }
         }
 
@@ -192,12 +323,11 @@ namespace nap
             }
 
             // if auto reconnect is enabled start the reconnection timer
-            if(mEnableAutoReconnect)
-            {
-                mReconnectTimer.reset();
-                mReconnectTimer.start();
-            }
+            scheduleReconnect();
         }
+
+        // process connected socket or reconnect timer
+        requestProcess();
     }
 
 
@@ -221,14 +351,17 @@ namespace nap
                 logError(err.message());
             }
 
-            // if auto reconnect is enabled start the reconnection time
-            if(mEnableAutoReconnect)
-            {
-                mReconnectTimer.reset();
-            }
+            // if auto reconnect is enabled start the reconnection timer
+            scheduleReconnect();
+
+            // discard queued messages, notifying their senders
+            clearQueue();
+            closeSharedChannel();
 
             // trigger disconnected signal
-            disconnected.trigger();
+            if(auto* metrics = getEnabledMetrics())
+                metrics->recordDisconnect();
+            deliver(SocketEvent(static_cast<int>(EEvent::DISCONNECTED), 0));
 
             return true;
         }
@@ -237,6 +370,62 @@ namespace nap
     }
 
 
+    void SocketClient::scheduleReconnect()
+    {
+        if(!mEnableAutoReconnect)
+            return;
+
+        // the first attempt after losing the connection can be made right away
+        int64 delay = 0;
+        int attempt = mReconnectAttempt;
+        mReconnectAttempt = std::min(mReconnectAttempt + 1, 64);
+        if(!mReconnectImmediately || attempt > 0)
+        {
+            if(mReconnectImmediately)
+                attempt--;
+
+            // grow the interval with every failed attempt, up to the maximum interval
+            double interval = static_cast<double>(std::max(mAutoReconnectIntervalMillis, 0));
+            double max_interval = std::max(static_cast<double>(mAutoReconnectMaxIntervalMillis), interval);
+            interval = std::min(interval * std::pow(static_cast<double>(mAutoReconnectBackoff), attempt), max_interval);
+
+            // randomize part of the interval, clients that lost the same server don't reconnect in lockstep
+            std::uniform_real_distribution<double> jitter(1.0 - static_cast<double>(mAutoReconnectJitter), 1.0);
+            delay = static_cast<int64>(interval * jitter(mReconnectRandom));
+            logInfo(utility::stringFormat("Reconnecting in %lld ms", static_cast<long long>(delay)));
+        }
+
+        startTimer(mReconnectTimer, delay, [this]()
+        {
+            if(!mConnecting.load() && !mSocketReady.load())
+                connect();
+        });
+    }
+
+
+    void SocketClient::startTimer(Timer& timer, int64 millis, std::function<void()> handler)
+    {
+        // cancels the pending wait, a handler that is already queued sees the new generation and doesn't run
+        uint64 generation = ++timer.mGeneration;
+        timer.mTimer->expires_after(std::chrono::milliseconds(std::max<int64>(millis, 0)));
+        timer.mTimer->async_wait([&timer, generation, handler = std::move(handler)](const asio::error_code& errorCode)
+        {
+            // cancelled, or stopped or restarted after the handler was queued
+            if(errorCode || timer.mGeneration != generation)
+                return;
+
+            handler();
+        });
+    }
+
+
+    void SocketClient::stopTimer(Timer& timer)
+    {
+        timer.mGeneration++;
+        timer.mTimer->cancel();
+    }
+
+
 	void SocketClient::process()
 	{
         std::function<void()> action;
@@ -245,7 +434,10 @@ namespace nap
             action();
         }
 
-        if (mSocketReady.load())
+        if (mSocketReady.load() && mSharedChannel.isOpen())
+        {
+            processSharedChannel();
+        }else if (mSocketReady.load())
         {
             if(mSocket->is_open())
             {
@@ -253,62 +445,101 @@ namespace nap
                 asio::error_code err;
 
                 // let the socket send queued messages
-                std::string message;
                 if(!mWritingData)
                 {
-                    if (mQueue.try_dequeue(message))
+                    // dequeue queued messages up to the batch budget, messages the framing can't encode are dropped
+                    size_t batch_count = 0;
+                    size_t batch_bytes = 0;
+                    size_t max_count = static_cast<size_t>(std::max(mWriteBatchMaxMessages, 1));
+                    while(batch_count < max_count && batch_bytes < static_cast<size_t>(mWriteBatchMaxBytes))
                     {
-                        mWritingData = true;
-                        mWriteResponseTimer.reset();
-                        mWriteResponseTimer.start();
-
-                        mWriteBuffer = message;
-                        asio::async_write(*mSocket,
-                                          asio::buffer(mWriteBuffer),
-                                          asio::transfer_exactly(mWriteBuffer.size()),
-                                          [this](const asio::error_code& errorCode, std::size_t bytes_transferred)
+                        if(mWriteBatch.size() <= batch_count)
                         {
-                            // not writing data anymore
-                            mWritingData = false;
+                            mWriteBatch.emplace_back();
+                            mWriteEncodings.emplace_back();
+                        }
 
-                            // handle error
-                            handleError(errorCode);
+                        auto& message = mWriteBatch[batch_count];
+                        if(!mQueue.pop(message))
+                            break;
 
-                            // stop response timer
-                            mWriteResponseTimer.stop();
-                        });
+                        if(!encodeFrame(message.mPayload.size(), mWriteEncodings[batch_count]))
+                        {
+                            logError(utility::stringFormat("Cannot frame message of %zu bytes, message dropped", message.mPayload.size()));
+                            message.complete(asio::error::message_size);
+                            continue;
+                        }
+
+                        batch_bytes += message.mPayload.size();
+                        batch_count++;
                     }
-                }else
-                {
-                    if(mWriteResponseTimer.getMillis().count() > mWriteTimeOutMillis)
+
+                    if (batch_count > 0)
                     {
-                        // stop response timer
-                        mWriteResponseTimer.stop();
+                        mWritingData = true;
+                        startTimer(mWriteTimer, mWriteTimeOutMillis, [this]()
+                        {
+                            if(!mWritingData)
+                                return;
 
-                        // not writing data
-                        mWritingData = false;
+                            // not writing data
+                            mWritingData = false;
+
+                            // socket is not ready
+                            mSocketReady.store(false);
 
-                        // socket is not ready
-                        mSocketReady.store(false);
+                            // timeout occured
+                            // log error to console
+                            logError("Write timeout occured!");
 
-                        // timeout occured
-                        // log error to console
-                        logError("Write timeout occured!");
+                            // close socket
+                            asio::error_code error_code;
+                            mSocket->close(error_code);
+                            if(error_code)
+                            {
+                                logError(error_code.message());
+                            }
 
-                        // close socket
-                        asio::error_code error_code;
-                        mSocket->close(error_code);
-                        if(error_code)
+                            // if auto reconnect is enabled start the reconnection timer
+                            scheduleReconnect();
+                        });
+
+                        // gather all frames of the batch into a single vectored write
+                        mWriteBuffers.clear();
+                        for(size_t i = 0; i < batch_count; i++)
                         {
-                            logError(error_code.message());
+                            const auto& encoding = mWriteEncodings[i];
+                            if(encoding.mHeaderSize > 0)
+                                mWriteBuffers.emplace_back(asio::buffer(encoding.mHeader.data(), encoding.mHeaderSize));
+                            mWriteBuffers.emplace_back(mWriteBatch[i].mPayload.buffer());
+                            if(encoding.mTrailer.size() > 0)
+                                mWriteBuffers.emplace_back(encoding.mTrailer);
                         }
 
-                        // if auto reconnect is enabled start the reconnection timer
-                        if(mEnableAutoReconnect)
+                        asio::async_write(*mSocket,
+                                          mWriteBuffers,
+                                          [this, batch_count](const asio::error_code& errorCode, std::size_t bytes_transferred)
                         {
-                            mReconnectTimer.reset();
-                            mReconnectTimer.start();
-                        }
+                            // not writing data anymore, notify the senders and return the written payloads to the pool
+                            mWritingData = false;
+                            for(size_t i = 0; i < batch_count && !errorCode; i++)
+                                recordSent(mWriteBatch[i]);
+
+                            for(auto& message : mWriteBatch)
+                            {
+                                message.complete(errorCode);
+                                message.mPayload = SocketPayload();
+                            }
+
+                            // handle error
+                            handleError(errorCode);
+
+                            // stop response timer
+                            stopTimer(mWriteTimer);
+
+                            // write any remaining queued messages
+                            requestProcess();
+                        });
                     }
                 }
 
@@ -324,12 +555,36 @@ namespace nap
                     if(available>0)
                     {
                         mReceivingData = true;
-                        mReadResponseTimer.reset();
-                        mReadResponseTimer.start();
+                        startTimer(mReadTimer, mReadTimeOutMillis, [this]()
+                        {
+                            if(!mReceivingData)
+                                return;
+
+                            // stop receiving data
+                            mReceivingData = false;
+
+                            // socket is not ready
+                            mSocketReady.store(false);
+
+                            // timeout occured
+                            // log error to console
+                            logError("Read timeout occured!");
+
+                            // close socket
+                            asio::error_code error_code;
+                            mSocket->close(error_code);
+                            if(error_code)
+                            {
+                                logError(error_code.message());
+                            }
+
+                            // if auto reconnect is enabled start the reconnection timer
+                            scheduleReconnect();
+                        });
 
                         // receive incoming messages
                         asio::async_read(*mSocket,
-                                         mStreamBuffer,
+                                         asio::buffer(mReceiveBuffer.prepare(available), available),
                                          asio::transfer_exactly(available),
                                          [this](const asio::error_code& errorCode, std::size_t bytes_transferred)
                         {
@@ -337,62 +592,27 @@ namespace nap
                             mReceivingData = false;
 
                             // stop timer
-                            mReadResponseTimer.stop();
-
-                            // Read the data received
-                            auto data = mStreamBuffer.data();
-
-                            // Consume it after
-                            mStreamBuffer.consume(bytes_transferred);
+                            stopTimer(mReadTimer);
 
                             if(!handleError(errorCode))
                             {
                                 // dispatch any received messages
-                                std::string data_string;
-                                if(bytes_transferred>0)
+                                mReceiveBuffer.commit(bytes_transferred);
+                                bool valid = dispatchMessages(mReceiveBuffer, mReceiveScanned, [this](const char* data, size_t size)
                                 {
-                                    data_string += std::string(asio::buffers_begin(data), asio::buffers_end(data));
+                                    dispatchMessage(data, size);
+                                });
+                                deliverReceivedBatch();
+
+                                // bail on data that can't be decoded
+                                if(!valid && handleError(asio::error::invalid_argument))
+                                    return;
 
-                                    if(!data_string.empty())
-                                    {
-                                        dataReceived.trigger(data_string);
-                                    }
-                                }
+                                // wait for more incoming data when event driven
+                                waitForData();
                             }
                         });
                     }
-                }else
-                {
-                    if(mReadResponseTimer.getMillis().count() > mReadTimeOutMillis)
-                    {
-                        // stop read response timer
-                        mReadResponseTimer.stop();
-
-                        // stop sending data
-                        mReceivingData = false;
-
-                        // socket is not ready
-                        mSocketReady.store(false);
-
-                        // timeout occured
-                        // log error to console
-                        logError("Read timeout occured!");
-
-                        // close socket
-                        asio::error_code error_code;
-                        mSocket->close(error_code);
-                        if(error_code)
-                        {
-                            logError(error_code.message());
-                        }
-
-                        // if auto reconnect is enabled start the reconnection timer
-                        if(mEnableAutoReconnect)
-                        {
-                            mReconnectTimer.reset();
-                            mReconnectTimer.start();
-                        }
-                    }
                 }
             }else
             {
@@ -410,67 +630,235 @@ namespace nap
                     logError(err.message());
                 }
 
-                // if auto reconnect is enabled start the reconnection time
-                if(mEnableAutoReconnect)
-                {
-                    mReconnectTimer.reset();
-                }
+                // if auto reconnect is enabled start the reconnection timer
+                scheduleReconnect();
 
                 // trigger disconnected signal
-                disconnected.trigger();
+                if(auto* metrics = getEnabledMetrics())
+                    metrics->recordDisconnect();
+                deliver(SocketEvent(static_cast<int>(EEvent::DISCONNECTED), 0));
             }
-        }else
+        }
+
+        postProcessSignal.trigger();
+	}
+
+
+    asio::error_code SocketClient::openSharedChannel()
+    {
+        closeSharedChannel();
+
+        utility::ErrorState error_state;
+        if(!mSharedChannel.create(static_cast<size_t>(std::max(mSharedMemorySize, 0)), error_state))
         {
-            // check if we need to reconnect the socket
-            if(mEnableAutoReconnect && !mConnecting.load())
+            logError(error_state.toString());
+            return asio::error::no_memory;
+        }
+
+        // pass the name of the channel to the server, afterwards the socket only carries wake ups
+        std::string handshake;
+        SocketSharedChannel::encodeHandshake(mSharedChannel.getName(), handshake);
+        asio::error_code err;
+        mSocket->non_blocking(false, err);
+        if(!err)
+            asio::write(*mSocket, asio::buffer(handshake), err);
+        if(!err)
+            mSocket->non_blocking(true, err);
+
+        if(err)
+            closeSharedChannel();
+        return err;
+    }
+
+
+    void SocketClient::closeSharedChannel()
+    {
+        if(mSharedMessagePending)
+        {
+            mSharedMessagePending = false;
+            mSharedMessage.complete(asio::error::operation_aborted);
+            mSharedMessage.mPayload = SocketPayload();
+        }
+        mSharedChannel.close();
+    }
+
+
+    void SocketClient::processSharedChannel()
+    {
+        // discard wake ups, they only make sure process() is called, the socket is non-blocking and reports a
+        // closed connection as eof
+        asio::error_code err;
+        while(!err)
+            mSocket->receive(asio::buffer(mWakeUpBuffer), 0, err);
+
+        if(err != asio::error::would_block && handleError(err))
+            return;
+
+        // write queued messages until the channel is full
+        bool written = false;
+        while(true)
+        {
+            if(!mSharedMessagePending)
             {
-                if(mReconnectTimer.getMillis().count() > mAutoReconnectIntervalMillis)
+                if(!mQueue.pop(mSharedMessage))
+                    break;
+
+                if(mSharedMessage.mPayload.size() > mSharedChannel.getMaxMessageSize())
                 {
-                    connect();
+                    logError(utility::stringFormat("Message of %zu bytes exceeds the shared memory size, message dropped", mSharedMessage.mPayload.size()));
+                    mSharedMessage.complete(asio::error::message_size);
+                    continue;
                 }
+                mSharedMessagePending = true;
+            }
+
+            // wait for the server to make room, unless it did so in the meantime
+            const auto& payload = mSharedMessage.mPayload;
+            if(!mSharedChannel.write(payload.data(), payload.size()))
+            {
+                if(mSharedChannel.armWrite(payload.size()))
+                    break;
+                continue;
             }
+
+            written = true;
+            mSharedMessagePending = false;
+            recordSent(mSharedMessage);
+            mSharedMessage.complete({});
+            mSharedMessage.mPayload = SocketPayload();
         }
 
-        if(mConnecting.load())
+        if(written && mSharedChannel.shouldNotifyReader() && handleError(notifyPeer(*mSocket)))
+            return;
+
+        // read until the channel stays empty after asking the server for a wake up
+        bool valid = true;
+        do
         {
-            if(mTimeoutTimer.getMillis().count() > mConnectTimeOutMillis)
-            {
-                mConnecting.store(false);
+            valid = mSharedChannel.read([this](const char* data, size_t size) { dispatchMessage(data, size); });
+        }while(valid && !mSharedChannel.armRead());
 
-                asio::error_code error_code;
-                mTimeoutTimer.reset();
-                mTimeoutTimer.stop();
+        // the batch refers to the ring, deliver it before handing the space back
+        deliverReceivedBatch();
+        mSharedChannel.release();
+        if(!valid)
+        {
+            handleError(asio::error::invalid_argument);
+            return;
+        }
 
-                // log error to console
-                logError("Connect timeout occured!");
+        if(mSharedChannel.shouldNotifyWriter() && handleError(notifyPeer(*mSocket)))
+            return;
 
-                // close socket
-                mSocket->close(error_code);
-                if(error_code)
-                {
-                    logError(error_code.message());
-                }
+        // wait for wake ups when event driven
+        waitForData();
+    }
 
-                // if auto reconnect is enabled start the reconnection timer
-                if(mEnableAutoReconnect)
-                {
-                    mReconnectTimer.reset();
-                    mReconnectTimer.start();
-                }
-            }
+
+    void SocketClient::dispatchMessage(const char* data, size_t size)
+    {
+        recordReceived(size);
+        if(batchMessage(mReceivedBatch, data, size))
+            return;
+
+        if(isDeliveredOnMainThread())
+        {
+            // the received data is only valid during this call, the main thread gets a pooled copy
+            deliver(SocketEvent(static_cast<int>(EEvent::MESSAGE), 0, data, size));
+            return;
         }
 
-        postProcessSignal.trigger();
-	}
+        triggerMessage(data, size, mReceivedMessage);
+    }
 
 
-    void SocketClient::clearQueue()
+    void SocketClient::deliverReceivedBatch()
+    {
+        deliverBatch(mReceivedBatch, static_cast<int>(EEvent::MESSAGE_BATCH), 0);
+    }
+
+
+    void SocketClient::triggerEvent(const SocketEvent& event)
+    {
+        switch(static_cast<EEvent>(event.mType))
+        {
+        case EEvent::CONNECTED:
+            connected.trigger();
+            break;
+        case EEvent::DISCONNECTED:
+            disconnected.trigger();
+            break;
+        case EEvent::WRITABILITY_CHANGED:
+            writabilityChanged.trigger(event.mValue);
+            break;
+        case EEvent::MESSAGE:
+            triggerMessage(event.mData, event.mSize, mDeliveredMessage);
+            break;
+        case EEvent::MESSAGE_BATCH:
+            dataBatchReceived.trigger(getEventBatch(event));
+            break;
+        }
+    }
+
+
+    void SocketClient::triggerMessage(const char* data, size_t size, std::string& message)
+    {
+        dataViewReceived.trigger(std::string_view(data, size));
+        if(mCopyReceivedMessages)
+        {
+            // reuse the capacity of the previous message
+            message.assign(data, size);
+            dataReceived.trigger(message);
+        }
+    }
+
+
+    void SocketClient::waitForData()
+    {
+        if(!isEventDriven() || mWaitingForData)
+            return;
+
+        mWaitingForData = true;
+        mSocket->async_wait(asio::socket_base::wait_read, [this](const asio::error_code& errorCode)
+        {
+            mWaitingForData = false;
+
+            // socket closed or wait cancelled
+            if(errorCode)
+                return;
+
+            auto err = checkReadable(*mSocket);
+            if(handleError(err))
+                return;
+
+            requestProcess();
+        });
+    }
+
+
+    void SocketClient::enqueueAction(std::function<void()> action)
+    {
+        mActionQueue.enqueue(std::move(action));
+        requestProcess();
+    }
+
+
+    void SocketClient::enqueueSignalAction(std::function<void()> action)
     {
-        while(mQueue.size_approx()>0)
+        // signals delivered on the main thread are connected there as well
+        if(isDeliveredOnMainThread())
         {
-            std::string message;
-            mQueue.try_dequeue(message);
+            action();
+            return;
         }
+
+        enqueueAction(std::move(action));
+    }
+
+
+    void SocketClient::clearQueue()
+    {
+        mQueue.clear();
     }
 
 
@@ -486,6 +874,30 @@ namespace nap
     }
 
 
+    SocketQueueDepth SocketClient::getQueueDepth() const
+    {
+        return mQueue.getDepth();
+    }
+
+
+    uint64 SocketClient::getDroppedCount() const
+    {
+        return mQueue.getDroppedCount();
+    }
+
+
+    SocketQueueDepth SocketClient::getTotalQueueDepth() const
+    {
+        return mQueue.getDepth();
+    }
+
+
+    bool SocketClient::isWritable() const
+    {
+        return mQueue.isWritable();
+    }
+
+
     void SocketClient::logError(const std::string& message)
     {
         if(mEnableLog)
@@ -506,7 +918,7 @@ namespace nap
 
     void SocketClient::enableLog(bool enableLog)
     {
-        mActionQueue.enqueue([this, enableLog]()
+        enqueueAction([this, enableLog]()
         {
             mEnableLog = enableLog;
         });
@@ -515,7 +927,7 @@ namespace nap
 
     void SocketClient::addMessageReceivedSlot(Slot<const std::string&>& slot)
     {
-        mActionQueue.enqueue([this, &slot]()
+        enqueueSignalAction([this, &slot]()
         {
             dataReceived.connect(slot);
         });
@@ -524,16 +936,52 @@ namespace nap
 
     void SocketClient::removeMessageReceivedSlot(Slot<const std::string&>& slot)
     {
-        mActionQueue.enqueue([this, &slot]()
+        enqueueSignalAction([this, &slot]()
         {
             dataReceived.disconnect(slot);
         });
     }
 
 
+    void SocketClient::addMessageViewReceivedSlot(Slot<std::string_view>& slot)
+    {
+        enqueueSignalAction([this, &slot]()
+        {
+            dataViewReceived.connect(slot);
+        });
+    }
+
+
+    void SocketClient::removeMessageViewReceivedSlot(Slot<std::string_view>& slot)
+    {
+        enqueueSignalAction([this, &slot]()
+        {
+            dataViewReceived.disconnect(slot);
+        });
+    }
+
+
+    void SocketClient::addMessageBatchReceivedSlot(Slot<const std::vector<std::string_view>&>& slot)
+    {
+        enqueueSignalAction([this, &slot]()
+        {
+            dataBatchReceived.connect(slot);
+        });
+    }
+
+
+    void SocketClient::removeMessageBatchReceivedSlot(Slot<const std::vector<std::string_view>&>& slot)
+    {
+        enqueueSignalAction([this, &slot]()
+        {
+            dataBatchReceived.disconnect(slot);
+        });
+    }
+
+
     void SocketClient::addConnectedSlot(Slot<>& slot)
     {
-        mActionQueue.enqueue([this, &slot]()
+        enqueueSignalAction([this, &slot]()
         {
             connected.connect(slot);
         });
@@ -542,7 +990,7 @@ namespace nap
 
     void SocketClient::removeConnectedSlot(Slot<>& slot)
     {
-        mActionQueue.enqueue([this, &slot]()
+        enqueueSignalAction([this, &slot]()
         {
             connected.disconnect(slot);
         });
@@ -550,7 +998,7 @@ namespace nap
 
     void SocketClient::addDisconnectedSlot(Slot<>& slot)
     {
-        mActionQueue.enqueue([this, &slot]()
+        enqueueSignalAction([this, &slot]()
         {
             disconnected.connect(slot);
         });
@@ -559,16 +1007,34 @@ namespace nap
 
     void SocketClient::removeDisconnectedSlot(Slot<>& slot)
     {
-        mActionQueue.enqueue([this, &slot]()
+        enqueueSignalAction([this, &slot]()
         {
             disconnected.disconnect(slot);
         });
     }
 
 
+    void SocketClient::addWritabilityChangedSlot(Slot<bool>& slot)
+    {
+        enqueueSignalAction([this, &slot]()
+        {
+            writabilityChanged.connect(slot);
+        });
+    }
+
+
+    void SocketClient::removeWritabilityChangedSlot(Slot<bool>& slot)
+    {
+        enqueueSignalAction([this, &slot]()
+        {
+            writabilityChanged.disconnect(slot);
+        });
+    }
+
+
     void SocketClient::addPostProcessSlot(Slot<>& slot)
     {
-        mActionQueue.enqueue([this, &slot]()
+        enqueueAction([this, &slot]()
         {
             postProcessSignal.connect(slot);
         });
@@ -577,7 +1043,7 @@ namespace nap
 
     void SocketClient::removePostProcessSlot(Slot<>& slot)
     {
-        mActionQueue.enqueue([this, &slot]()
+        enqueueAction([this, &slot]()
         {
             postProcessSignal.disconnect(slot);
         });
@@ -6,34 +6,45 @@
 
 // External includes
 #include <nap/device.h>
+#include <array>
 #include <queue>
 #include <mutex>
+#include <random>
+#include <string_view>
 
 // ASIO includes
 #include <asio/ts/buffer.hpp>
 #include <asio/ts/internet.hpp>
 #include <asio/io_service.hpp>
 #include <asio/system_error.hpp>
-#include <asio/streambuf.hpp>
+#include <asio/steady_timer.hpp>
 
 // NAP includes
 #include <utility/threading.h>
 #include <concurrentqueue.h>
 #include <nap/signalslot.h>
-#include <nap/timer.h>
 
 // Local includes
 #include "socketadapter.h"
+#include "socketpayload.h"
+#include "socketsendqueue.h"
+#include "socketsharedmemory.h"
 
 namespace nap
 {
 	//////////////////////////////////////////////////////////////////////////
 
     /**
-     * SocketClient creates a asio::tcp::socket and tries to connect to an endpoint.
-     * Once connected it is able to send and receive data as std::strings
+     * SocketClient creates a stream socket and tries to connect to an endpoint. The endpoint is either a TCP endpoint or,
+     * when 'Transport' is set to Local, a local stream socket for servers on the same host.
+     * With the Shared Memory transport the client connects to the local stream socket of the server and creates a
+     * SocketSharedChannel, messages are exchanged through shared memory and the socket only carries wake ups. Messages
+     * are delimited by the channel, the 'Framing' property is ignored.
+     * Once connected it is able to send and receive data as std::strings. Sent messages are copied into blocks of the
+     * SocketBufferPool
      * SocketClient extends on SocketAdapter, this means the process() function will be called by the SocketThread
-     * assigned to the SocketAdapter.
+     * assigned to the SocketAdapter. Its signals are dispatched on that thread as well, unless 'Signal Delivery' is set
+     * to Main Thread, in which case they are dispatched by SocketService::update() and received data is copied once.
      */
 	class NAPAPI SocketClient final : public SocketAdapter
 	{
@@ -52,11 +63,21 @@ namespace nap
 		void onDestroy() override;
 
         /**
-         * Send message to server
+         * Send message to server. When the outgoing queue is full the 'Queue Overflow Policy' is applied
          * @param message the message
          */
 		void send(const std::string& message);
 
+        /**
+         * Send message to server and get notified when it is handed to the kernel.
+         * The callback is invoked exactly once: on the thread processing this client when the message is written or
+         * discarded, or on the calling thread when the message is not queued, see SocketSendCallback
+         * @param message the message
+         * @param callback called with the result of sending the message, can be nullptr
+         * @return whether the message is queued
+         */
+        ESocketQueueResult send(const std::string& message, SocketSendCallback callback);
+
         /**
          * Connect to server
          */
@@ -79,12 +100,50 @@ namespace nap
          */
         bool isConnecting() const;
 
+        /**
+         * Returns the number of messages and bytes waiting to be sent. Thread-safe
+         * @return the outgoing queue depth
+         */
+        SocketQueueDepth getQueueDepth() const;
+
+        /**
+         * Returns the number of messages dropped because the outgoing queue was full. Thread-safe
+         * @return the number of dropped messages
+         */
+        uint64 getDroppedCount() const;
+
+        /**
+         * Returns false when more bytes are queued than the 'Queue High Watermark', until the queue drains to the
+         * 'Queue Low Watermark'. Always true when the watermarks are disabled. Thread-safe
+         * @return whether the client accepts more messages without growing its backlog
+         */
+        bool isWritable() const;
+
         void enableLog(bool enableLog);
     public:
         void addMessageReceivedSlot(Slot<const std::string&>& slot);
 
         void removeMessageReceivedSlot(Slot<const std::string&>& slot);
 
+        /**
+         * Adds a slot receiving a read-only view into the receive buffer for every received message.
+         * The view is only valid for the duration of the call, copy the data to keep it
+         * @param slot the slot
+         */
+        void addMessageViewReceivedSlot(Slot<std::string_view>& slot);
+
+        void removeMessageViewReceivedSlot(Slot<std::string_view>& slot);
+
+        /**
+         * Adds a slot receiving read-only views of all messages received in one pass, requires 'Batch Received Messages'.
+         * When batching the per-message receive signals are not triggered.
+         * The views are only valid for the duration of the call, copy the data to keep it
+         * @param slot the slot
+         */
+        void addMessageBatchReceivedSlot(Slot<const std::vector<std::string_view>&>& slot);
+
+        void removeMessageBatchReceivedSlot(Slot<const std::vector<std::string_view>&>& slot);
+
         void addConnectedSlot(Slot<>& slot);
 
         void removeConnectedSlot(Slot<>& slot);
@@ -93,6 +152,14 @@ namespace nap
 
         void removeDisconnectedSlot(Slot<>& slot);
 
+        /**
+         * Adds a slot called with the new writable state every time the outgoing queue crosses a watermark, see isWritable()
+         * @param slot the slot
+         */
+        void addWritabilityChangedSlot(Slot<bool>& slot);
+
+        void removeWritabilityChangedSlot(Slot<bool>& slot);
+
         void addPostProcessSlot(Slot<>& slot);
 
         void removePostProcessSlot(Slot<>& slot);
@@ -100,19 +167,51 @@ namespace nap
 		// properties
 		int mPort 							= 13251; 		///< Property: 'Port' the port the client socket binds to
 		std::string mRemoteIp 				= "10.8.0.3";	///< Property: 'Endpoint' the ip address the client socket binds to
+        ESocketTransport mTransport         = ESocketTransport::TCP; ///< Property: 'Transport' connect over TCP or to a local stream socket on the same host
+        std::string mLocalPath              = "";           ///< Property: 'Local Path' path of the local socket to connect to, a path starting with '@' refers to the Linux abstract namespace
+        int mSharedMemorySize               = 1048576;      ///< Property: 'Shared Memory Size' capacity in bytes of each direction of the shared memory channel, rounded up to a power of two
 		bool mConnectOnInit                 = true;         ///< Property: 'Connect on init' whether the client should try to connect after successful initialization
         bool mEnableAutoReconnect           = true;         ///< Property: 'Reconnect On Disconnect' whether the client should try to reconnect after an error or dissconnect
-        int  mAutoReconnectIntervalMillis   = 5000;         ///< Property: 'Reconnect Interval' the time interval at which the client should try to reconnect in milliseconds
+        int  mAutoReconnectIntervalMillis   = 5000;         ///< Property: 'Reconnect Interval' the time interval at which the client should try to reconnect in milliseconds, the interval before the first backoff
+        int  mAutoReconnectMaxIntervalMillis = 30000;       ///< Property: 'Reconnect Max Interval' the reconnect interval doesn't grow beyond this many milliseconds
+        float mAutoReconnectBackoff         = 1.0f;         ///< Property: 'Reconnect Backoff' factor the reconnect interval grows with after every failed attempt, 1 keeps the interval fixed
+        float mAutoReconnectJitter          = 0.0f;         ///< Property: 'Reconnect Jitter' fraction of the reconnect interval that is randomized, spreads the reconnects of clients that lost the same server
+        bool mReconnectImmediately          = false;        ///< Property: 'Reconnect Immediately' whether the first attempt after losing the connection is made right away
         bool mEnableLog                     = false;        ///< Property: 'Enable Log' whether the client should log to the console
 	    int  mConnectTimeOutMillis          = 5000;
         int  mReadTimeOutMillis             = 200;
         int  mWriteTimeOutMillis            = 200;
+        int  mWriteBatchMaxMessages         = 64;           ///< Property: 'Write Batch Messages' maximum number of queued messages sent with a single write
+        int  mWriteBatchMaxBytes            = 65536;        ///< Property: 'Write Batch Bytes' a write batch is closed once it holds this many payload bytes, at least one message is always sent
     protected:
 		/**
 		 * The process function
 		 */
 		void process() override;
+
+        /**
+         * @return number of messages and bytes waiting to be sent
+         */
+        SocketQueueDepth getTotalQueueDepth() const override;
+
+        /**
+         * Triggers the signals of a client event, see EEvent
+         * @param event the event
+         */
+        void triggerEvent(const SocketEvent& event) override;
     private:
+        /**
+         * Events delivered by the client
+         */
+        enum class EEvent : int
+        {
+            CONNECTED               = 0,
+            DISCONNECTED            = 1,
+            WRITABILITY_CHANGED     = 2,
+            MESSAGE                 = 3,
+            MESSAGE_BATCH           = 4
+        };
+
         // Signals
         Signal<> postProcessSignal;
 
@@ -121,6 +220,17 @@ namespace nap
          */
         Signal<const std::string&> dataReceived;
 
+        /**
+         * Message received signal passing a view into the receive buffer, dispatched on thread assigned to this SocketAdapter
+         */
+        Signal<std::string_view> dataViewReceived;
+
+        /**
+         * Messages received signal passing views of all messages received in one pass, dispatched on the thread assigned
+         * to this SocketAdapter instead of the per-message signals when 'Batch Received Messages' is enabled
+         */
+        Signal<const std::vector<std::string_view>&> dataBatchReceived;
+
         /**
          * Connected signal, dispatched on thread assigned to this SocketAdapter
          */
@@ -131,6 +241,11 @@ namespace nap
          */
         Signal<> disconnected;
 
+        /**
+         * Writable state changed signal, dispatched on thread assigned to this SocketAdapter
+         */
+        Signal<bool> writabilityChanged;
+
         /**
          * Handle connect callback
          * @param errorCode any potential errorcode
@@ -144,11 +259,97 @@ namespace nap
          */
         bool handleError(const asio::error_code& errorCode);
 
+        /**
+         * Starts the reconnect timer when auto reconnect is enabled. The interval grows with every failed attempt until
+         * the client is connected again, part of the interval is randomized
+         */
+        void scheduleReconnect();
+
+        /**
+         * Timer expiring on the thread handling the client. Every start or stop begins a new generation, a handler
+         * only runs when the timer is still in the generation it was started in
+         */
+        struct Timer
+        {
+            std::unique_ptr<asio::steady_timer> mTimer;
+            uint64                              mGeneration = 0;
+        };
+
+        /**
+         * Starts or restarts a timer, the handler is called once when the timer expires and not when the timer is
+         * stopped or restarted before
+         * @param timer the timer
+         * @param millis time in milliseconds until the timer expires
+         * @param handler called on the thread handling the client when the timer expires
+         */
+        void startTimer(Timer& timer, int64 millis, std::function<void()> handler);
+
+        /**
+         * Stops a timer, its handler is not called
+         * @param timer the timer
+         */
+        void stopTimer(Timer& timer);
+
         /**
          * Clears current message queue
          */
         void clearQueue();
 
+        /**
+         * Creates the shared memory channel and passes it to the server
+         * @return error that occurred while setting up the channel
+         */
+        asio::error_code openSharedChannel();
+
+        /**
+         * Closes the shared memory channel, the message waiting for room is discarded
+         */
+        void closeSharedChannel();
+
+        /**
+         * Exchanges messages through the shared memory channel
+         */
+        void processSharedChannel();
+
+        /**
+         * Dispatches a received message
+         * @param data pointer to the message
+         * @param size size of the message in bytes
+         */
+        void dispatchMessage(const char* data, size_t size);
+
+        /**
+         * Triggers the receive signals of a message
+         * @param data pointer to the message
+         * @param size size of the message in bytes
+         * @param message string the message is copied into when received messages are copied
+         */
+        void triggerMessage(const char* data, size_t size, std::string& message);
+
+        /**
+         * Triggers the batch receive signal with the messages received in the current pass
+         */
+        void deliverReceivedBatch();
+
+        /**
+         * Waits for the socket to become readable and requests a process call when it does.
+         * Only has effect when the SocketThread is EVENT_DRIVEN, otherwise the socket is polled every process call
+         */
+        void waitForData();
+
+        /**
+         * Queues an action to be executed on the next process call and requests processing. Thread-safe
+         * @param action the action to execute
+         */
+        void enqueueAction(std::function<void()> action);
+
+        /**
+         * Executes an action connecting or disconnecting a slot on the thread the signals are triggered on,
+         * right away when signals are delivered on the main thread, see 'Signal Delivery'
+         * @param action the action to execute
+         */
+        void enqueueSignalAction(std::function<void()> action);
+
         /**
          * Log an error to the console
          * @param message the message to log
@@ -162,27 +363,44 @@ namespace nap
         void logInfo(const std::string& message);
 
 		// ASIO
-		std::unique_ptr<asio::ip::tcp::socket> 		mSocket;
-        std::unique_ptr<asio::ip::tcp::endpoint> 	mRemoteEndpoint;
+		std::unique_ptr<SocketStreamProtocol::socket> 	mSocket;
+        std::unique_ptr<SocketStreamProtocol::endpoint> mRemoteEndpoint;
 
 		// Threading
-		moodycamel::ConcurrentQueue<std::string> 	mQueue;
+		SocketSendQueue 							mQueue;
         std::atomic_bool mSocketReady = { false };
         std::atomic_bool mConnecting = { false };
 
-        // Timers
-        SteadyTimer mReconnectTimer;
-        SteadyTimer mTimeoutTimer;
-        SteadyTimer mWriteResponseTimer;
-        SteadyTimer mReadResponseTimer;
+        // Timers, expire on the thread handling the client
+        Timer mReconnectTimer;
+        Timer mConnectTimer;
+        Timer mWriteTimer;
+        Timer mReadTimer;
+
+        // Reconnect backoff
+        int                 mReconnectAttempt = 0;      ///< number of reconnect attempts since the connection was lost
+        std::minstd_rand    mReconnectRandom;
 
         //
         bool mWritingData = false;
         bool mReceivingData = false;
+        bool mWaitingForData = false;
 
         //
-        asio::streambuf     mStreamBuffer;
-        std::string         mWriteBuffer;
+        SocketReceiveBuffer mReceiveBuffer;
+        size_t              mReceiveScanned = 0;
+        std::string         mReceivedMessage;
+        std::string         mDeliveredMessage;      ///< copy of the last message delivered on the main thread
+        std::vector<std::string_view>       mReceivedBatch;             ///< messages received in the current pass
+        std::vector<SocketQueuedMessage>    mWriteBatch;
+        std::vector<SocketFrameEncoding>    mWriteEncodings;
+        std::vector<asio::const_buffer>     mWriteBuffers;
+
+        // Shared memory
+        SocketSharedChannel                 mSharedChannel;
+        SocketQueuedMessage                 mSharedMessage;             ///< message waiting for room in the channel
+        bool                                mSharedMessagePending = false;
+        std::array<char, 256>               mWakeUpBuffer;
 
         moodycamel::ConcurrentQueue<std::function<void()>> mActionQueue;
 	};
@@ -0,0 +1,257 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#include "socketframing.h"
+
+// External includes
+#include <cstring>
+
+RTTI_BEGIN_ENUM(nap::ESocketLengthPrefix)
+    RTTI_ENUM_VALUE(nap::ESocketLengthPrefix::U16,      "U16"),
+    RTTI_ENUM_VALUE(nap::ESocketLengthPrefix::U32,      "U32"),
+    RTTI_ENUM_VALUE(nap::ESocketLengthPrefix::VARINT,   "VarInt")
+RTTI_END_ENUM
+
+RTTI_BEGIN_CLASS_NO_DEFAULT_CONSTRUCTOR(nap::SocketFraming)
+    RTTI_PROPERTY("Max Message Size",   &nap::SocketFraming::mMaxMessageSize,       nap::rtti::EPropertyMetaData::Default)
+RTTI_END_CLASS
+
+RTTI_BEGIN_CLASS(nap::LengthPrefixFraming)
+    RTTI_PROPERTY("Prefix",             &nap::LengthPrefixFraming::mPrefix,         nap::rtti::EPropertyMetaData::Default)
+    RTTI_PROPERTY("Big Endian",         &nap::LengthPrefixFraming::mBigEndian,      nap::rtti::EPropertyMetaData::Default)
+RTTI_END_CLASS
+
+RTTI_BEGIN_CLASS(nap::DelimiterFraming)
+    RTTI_PROPERTY("Delimiter",          &nap::DelimiterFraming::mDelimiter,         nap::rtti::EPropertyMetaData::Default)
+RTTI_END_CLASS
+
+RTTI_BEGIN_CLASS(nap::FixedSizeFraming)
+    RTTI_PROPERTY("Message Size",       &nap::FixedSizeFraming::mMessageSize,       nap::rtti::EPropertyMetaData::Default)
+RTTI_END_CLASS
+
+namespace nap
+{
+    //////////////////////////////////////////////////////////////////////////
+    // SocketFraming
+    //////////////////////////////////////////////////////////////////////////
+
+    bool SocketFraming::init(utility::ErrorState& errorState)
+    {
+        return errorState.check(mMaxMessageSize > 0, "Max Message Size must be larger than 0");
+    }
+
+
+    bool SocketFraming::decodeAll(SocketReceiveBuffer& buffer, size_t& scanned, const std::function<void(const char*, size_t)>& dispatch) const
+    {
+        SocketFrame frame;
+        while(buffer.size() > 0)
+        {
+            switch(decode(buffer.data(), buffer.size(), scanned, frame))
+            {
+            case ESocketFrameStatus::COMPLETE:
+                dispatch(buffer.data() + frame.mMessageOffset, frame.mMessageSize);
+                buffer.consume(frame.mFrameSize);
+                scanned = 0;
+                break;
+            case ESocketFrameStatus::INCOMPLETE:
+                return true;
+            case ESocketFrameStatus::INVALID:
+                return false;
+            }
+        }
+        return true;
+    }
+
+
+    //////////////////////////////////////////////////////////////////////////
+    // LengthPrefixFraming
+    //////////////////////////////////////////////////////////////////////////
+
+    bool LengthPrefixFraming::init(utility::ErrorState& errorState)
+    {
+        return SocketFraming::init(errorState);
+    }
+
+
+    ESocketFrameStatus LengthPrefixFraming::decode(const char* data, size_t size, size_t& scanned, SocketFrame& frame) const
+    {
+        const auto* bytes = reinterpret_cast<const uint8*>(data);
+        uint64 length = 0;
+        size_t header_size = 0;
+        switch(mPrefix)
+        {
+        case ESocketLengthPrefix::U16:
+        case ESocketLengthPrefix::U32:
+        {
+            header_size = mPrefix == ESocketLengthPrefix::U16 ? 2 : 4;
+            if(size < header_size)
+                return ESocketFrameStatus::INCOMPLETE;
+
+            for(size_t i = 0; i < header_size; i++)
+            {
+                size_t shift = mBigEndian ? (header_size - 1 - i) * 8 : i * 8;
+                length |= static_cast<uint64>(bytes[i]) << shift;
+            }
+            break;
+        }
+        case ESocketLengthPrefix::VARINT:
+        {
+            // 7 bits per byte, least significant group first, high bit set on all but the last byte
+            bool last = false;
+            while(!last)
+            {
+                if(header_size == 10)
+                    return ESocketFrameStatus::INVALID;
+
+                if(header_size == size)
+                    return ESocketFrameStatus::INCOMPLETE;
+
+                length |= static_cast<uint64>(bytes[header_size] & 0x7f) << (header_size * 7);
+                last = (bytes[header_size] & 0x80) == 0;
+                header_size++;
+            }
+            break;
+        }
+        }
+
+        if(length > static_cast<uint64>(mMaxMessageSize))
+            return ESocketFrameStatus::INVALID;
+
+        if(size < header_size + length)
+            return ESocketFrameStatus::INCOMPLETE;
+
+        frame.mMessageOffset = header_size;
+        frame.mMessageSize = static_cast<size_t>(length);
+        frame.mFrameSize = header_size + frame.mMessageSize;
+        return ESocketFrameStatus::COMPLETE;
+    }
+
+
+    bool LengthPrefixFraming::encode(size_t messageSize, SocketFrameEncoding& encoding) const
+    {
+        if(messageSize > static_cast<size_t>(mMaxMessageSize))
+            return false;
+
+        auto* header = reinterpret_cast<uint8*>(encoding.mHeader.data());
+        encoding.mTrailer = asio::const_buffer();
+        switch(mPrefix)
+        {
+        case ESocketLengthPrefix::U16:
+        case ESocketLengthPrefix::U32:
+        {
+            size_t header_size = mPrefix == ESocketLengthPrefix::U16 ? 2 : 4;
+            if(header_size == 2 && messageSize > 0xffff)
+                return false;
+
+            for(size_t i = 0; i < header_size; i++)
+            {
+                size_t shift = mBigEndian ? (header_size - 1 - i) * 8 : i * 8;
+                header[i] = static_cast<uint8>((messageSize >> shift) & 0xff);
+            }
+            encoding.mHeaderSize = header_size;
+            break;
+        }
+        case ESocketLengthPrefix::VARINT:
+        {
+            uint64 length = messageSize;
+            size_t header_size = 0;
+            do
+            {
+                header[header_size] = static_cast<uint8>(length & 0x7f);
+                length >>= 7;
+                if(length > 0)
+                    header[header_size] |= 0x80;
+                header_size++;
+            } while(length > 0);
+            encoding.mHeaderSize = header_size;
+            break;
+        }
+        }
+        return true;
+    }
+
+
+    //////////////////////////////////////////////////////////////////////////
+    // DelimiterFraming
+    //////////////////////////////////////////////////////////////////////////
+
+    bool DelimiterFraming::init(utility::ErrorState& errorState)
+    {
+        if(!SocketFraming::init(errorState))
+            return false;
+
+        return errorState.check(!mDelimiter.empty(), "Delimiter cannot be empty");
+    }
+
+
+    ESocketFrameStatus DelimiterFraming::decode(const char* data, size_t size, size_t& scanned, SocketFrame& frame) const
+    {
+        // continue scanning where the previous call left off, the delimiter might have been partially received
+        size_t delimiter_size = mDelimiter.size();
+        size_t start = scanned >= delimiter_size ? scanned - delimiter_size + 1 : 0;
+        for(size_t i = start; i + delimiter_size <= size; i++)
+        {
+            if(data[i] == mDelimiter[0] && std::memcmp(data + i, mDelimiter.data(), delimiter_size) == 0)
+            {
+                if(i > static_cast<size_t>(mMaxMessageSize))
+                    return ESocketFrameStatus::INVALID;
+
+                frame.mMessageOffset = 0;
+                frame.mMessageSize = i;
+                frame.mFrameSize = i + delimiter_size;
+                return ESocketFrameStatus::COMPLETE;
+            }
+        }
+
+        scanned = size;
+        if(size > static_cast<size_t>(mMaxMessageSize) + delimiter_size)
+            return ESocketFrameStatus::INVALID;
+
+        return ESocketFrameStatus::INCOMPLETE;
+    }
+
+
+    bool DelimiterFraming::encode(size_t messageSize, SocketFrameEncoding& encoding) const
+    {
+        if(messageSize > static_cast<size_t>(mMaxMessageSize))
+            return false;
+
+        encoding.mHeaderSize = 0;
+        encoding.mTrailer = asio::buffer(mDelimiter);
+        return true;
+    }
+
+
+    //////////////////////////////////////////////////////////////////////////
+    // FixedSizeFraming
+    //////////////////////////////////////////////////////////////////////////
+
+    bool FixedSizeFraming::init(utility::ErrorState& errorState)
+    {
+        if(!SocketFraming::init(errorState))
+            return false;
+
+        return errorState.check(mMessageSize > 0, "Message Size must be larger than 0");
+    }
+
+
+    ESocketFrameStatus FixedSizeFraming::decode(const char* data, size_t size, size_t& scanned, SocketFrame& frame) const
+    {
+        if(size < static_cast<size_t>(mMessageSize))
+            return ESocketFrameStatus::INCOMPLETE;
+
+        frame.mMessageOffset = 0;
+        frame.mMessageSize = mMessageSize;
+        frame.mFrameSize = mMessageSize;
+        return ESocketFrameStatus::COMPLETE;
+    }
+
+
+    bool FixedSizeFraming::encode(size_t messageSize, SocketFrameEncoding& encoding) const
+    {
+        encoding.mHeaderSize = 0;
+        encoding.mTrailer = asio::const_buffer();
+        return messageSize == static_cast<size_t>(mMessageSize);
+    }
+}
@@ -0,0 +1,163 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#pragma once
+
+// External includes
+#include <nap/resource.h>
+#include <nap/numeric.h>
+#include <array>
+#include <functional>
+
+// ASIO includes
+#include <asio/ts/buffer.hpp>
+
+// Local includes
+#include "socketreceivebuffer.h"
+
+namespace nap
+{
+    //////////////////////////////////////////////////////////////////////////
+
+    /**
+     * Result of decoding a frame
+     */
+    enum class ESocketFrameStatus : int
+    {
+        COMPLETE        = 0,    ///< a complete frame is available
+        INCOMPLETE      = 1,    ///< more data is required to complete the frame
+        INVALID         = 2     ///< the data can not be decoded, the stream is corrupt
+    };
+
+
+    /**
+     * Location of a decoded message inside the received data
+     */
+    struct NAPAPI SocketFrame
+    {
+        size_t mMessageOffset   = 0;    ///< offset of the message from the start of the frame
+        size_t mMessageSize     = 0;    ///< size of the message in bytes
+        size_t mFrameSize       = 0;    ///< size of the complete frame in bytes, including header and trailer
+    };
+
+
+    /**
+     * Header and trailer to write around a message
+     */
+    struct NAPAPI SocketFrameEncoding
+    {
+        std::array<char, 16>    mHeader;                ///< header bytes written before the message
+        size_t                  mHeaderSize = 0;        ///< number of valid header bytes
+        asio::const_buffer      mTrailer;               ///< trailer written after the message
+    };
+
+
+    /**
+     * Base class of all message framing codecs. A framing codec splits the received byte stream of a SocketClient or
+     * SocketServer connection into messages and frames outgoing messages. Without framing, the bytes returned by a
+     * single read are dispatched as one message.
+     * Decoding happens in place on the socket thread, see SocketReceiveBuffer.
+     */
+    class NAPAPI SocketFraming : public Resource
+    {
+        RTTI_ENABLE(Resource)
+    public:
+        /**
+         * Validates the maximum message size, derived codecs must call this first
+         * @param errorState contains the error when the properties are invalid
+         * @return true on success
+         */
+        bool init(utility::ErrorState& errorState) override;
+
+        /**
+         * Tries to decode a frame at the start of the given data
+         * @param data received data that is not consumed yet
+         * @param size number of received bytes
+         * @param scanned number of bytes at the start of the data already scanned by a previous call without finding a
+         * complete frame, allows codecs to continue where they left off. Reset to 0 when a frame is complete
+         * @param frame location of the message when complete
+         * @return decoding result
+         */
+        virtual ESocketFrameStatus decode(const char* data, size_t size, size_t& scanned, SocketFrame& frame) const = 0;
+
+        /**
+         * Creates the header and trailer to write around a message
+         * @param messageSize size of the message in bytes
+         * @param encoding the header and trailer
+         * @return false when the message can not be framed by this codec
+         */
+        virtual bool encode(size_t messageSize, SocketFrameEncoding& encoding) const = 0;
+
+        /**
+         * Decodes all complete frames in the buffer, calls the dispatch function for every message and consumes the frames.
+         * The message data passed to the dispatch function is only valid for the duration of the call
+         * @param buffer the receive buffer
+         * @param scanned scan state, see decode()
+         * @param dispatch function called for every message
+         * @return false when the buffer holds data that can not be decoded
+         */
+        bool decodeAll(SocketReceiveBuffer& buffer, size_t& scanned, const std::function<void(const char*, size_t)>& dispatch) const;
+
+        int mMaxMessageSize = 16 * 1024 * 1024;     ///< Property: 'Max Message Size' frames announcing a larger message are rejected as invalid
+    };
+
+
+    //////////////////////////////////////////////////////////////////////////
+
+    /**
+     * Type of length prefix written before every message
+     */
+    enum class ESocketLengthPrefix : int
+    {
+        U16         = 0,    ///< 2 byte unsigned integer
+        U32         = 1,    ///< 4 byte unsigned integer
+        VARINT      = 2     ///< unsigned LEB128 variable length integer, 1 to 10 bytes
+    };
+
+
+    /**
+     * Frames every message with a length prefix holding the size of the message
+     */
+    class NAPAPI LengthPrefixFraming : public SocketFraming
+    {
+        RTTI_ENABLE(SocketFraming)
+    public:
+        bool init(utility::ErrorState& errorState) override;
+        ESocketFrameStatus decode(const char* data, size_t size, size_t& scanned, SocketFrame& frame) const override;
+        bool encode(size_t messageSize, SocketFrameEncoding& encoding) const override;
+
+        ESocketLengthPrefix mPrefix = ESocketLengthPrefix::U32;     ///< Property: 'Prefix' type of length prefix
+        bool mBigEndian = true;                                         ///< Property: 'Big Endian' byte order of fixed size prefixes, network byte order by default
+    };
+
+
+    /**
+     * Frames every message by terminating it with a delimiter, the delimiter must not occur in messages
+     */
+    class NAPAPI DelimiterFraming : public SocketFraming
+    {
+        RTTI_ENABLE(SocketFraming)
+    public:
+        bool init(utility::ErrorState& errorState) override;
+        ESocketFrameStatus decode(const char* data, size_t size, size_t& scanned, SocketFrame& frame) const override;
+        bool encode(size_t messageSize, SocketFrameEncoding& encoding) const override;
+
+        std::string mDelimiter = "\n";      ///< Property: 'Delimiter' sequence terminating every message
+    };
+
+
+    /**
+     * Every message has the same fixed size, no header or trailer is written
+     */
+    class NAPAPI FixedSizeFraming : public SocketFraming
+    {
+        RTTI_ENABLE(SocketFraming)
+    public:
+        bool init(utility::ErrorState& errorState) override;
+        ESocketFrameStatus decode(const char* data, size_t size, size_t& scanned, SocketFrame& frame) const override;
+        bool encode(size_t messageSize, SocketFrameEncoding& encoding) const override;
+
+        int mMessageSize = 64;              ///< Property: 'Message Size' size of every message in bytes
+    };
+}
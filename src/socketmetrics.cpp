@@ -0,0 +1,231 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#include "socketmetrics.h"
+
+// External includes
+#include <utility/stringutils.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace nap
+{
+    /**
+     * @return index of the highest set bit, value must not be 0
+     */
+    static int getMagnitude(uint64 value)
+    {
+#if defined(_MSC_VER)
+        unsigned long index;
+        _BitScanReverse64(&index, value);
+        return static_cast<int>(index);
+#else
+        return 63 - __builtin_clzll(value);
+#endif
+    }
+
+
+    /**
+     * Formats a duration in nanoseconds with a readable unit
+     */
+    static std::string formatDuration(uint64 nanos)
+    {
+        if(nanos < 1000)
+            return utility::stringFormat("%lluns", static_cast<unsigned long long>(nanos));
+        if(nanos < 1000000)
+            return utility::stringFormat("%.1fus", static_cast<double>(nanos) / 1e3);
+        if(nanos < 1000000000)
+            return utility::stringFormat("%.1fms", static_cast<double>(nanos) / 1e6);
+        return utility::stringFormat("%.2fs", static_cast<double>(nanos) / 1e9);
+    }
+
+
+    static std::string formatLatency(const SocketLatencySnapshot& snapshot)
+    {
+        if(snapshot.mCount == 0)
+            return "-";
+
+        return utility::stringFormat("p50 %s p99 %s p99.9 %s max %s",
+            formatDuration(snapshot.mP50).c_str(), formatDuration(snapshot.mP99).c_str(),
+            formatDuration(snapshot.mP999).c_str(), formatDuration(snapshot.mMax).c_str());
+    }
+
+    //////////////////////////////////////////////////////////////////////////
+    // SocketLatencyHistogram
+    //////////////////////////////////////////////////////////////////////////
+
+    size_t SocketLatencyHistogram::getBucket(uint64 value)
+    {
+        // values below the sub-bucket count have a bucket of their own
+        if(value < sSubBucketCount)
+            return static_cast<size_t>(value);
+
+        // the sub-bucket is taken from the bits below the highest set bit
+        int shift = getMagnitude(value) - sSubBucketBits;
+        size_t sub_bucket = static_cast<size_t>(value >> shift) - sSubBucketCount;
+        return static_cast<size_t>(shift + 1) * sSubBucketCount + sub_bucket;
+    }
+
+
+    uint64 SocketLatencyHistogram::getBucketUpperBound(size_t bucket)
+    {
+        if(bucket < sSubBucketCount)
+            return static_cast<uint64>(bucket);
+
+        int shift = static_cast<int>(bucket / sSubBucketCount) - 1;
+        uint64 lower = static_cast<uint64>(sSubBucketCount + bucket % sSubBucketCount) << shift;
+        return lower + ((uint64(1) << shift) - 1);
+    }
+
+
+    void SocketLatencyHistogram::record(uint64 nanos)
+    {
+        mBuckets[getBucket(nanos)].fetch_add(1, std::memory_order_relaxed);
+        mCount.fetch_add(1, std::memory_order_relaxed);
+        mSum.fetch_add(nanos, std::memory_order_relaxed);
+
+        uint64 max = mMax.load(std::memory_order_relaxed);
+        while(nanos > max && !mMax.compare_exchange_weak(max, nanos, std::memory_order_relaxed)){}
+    }
+
+
+    uint64 SocketLatencyHistogram::getPercentile(double percentile) const
+    {
+        // count the buckets themselves, the total might be ahead of them while recording
+        uint64 total = 0;
+        for(const auto& bucket : mBuckets)
+            total += bucket.load(std::memory_order_relaxed);
+
+        if(total == 0)
+            return 0;
+
+        auto target = static_cast<uint64>(std::ceil(std::clamp(percentile, 0.0, 1.0) * static_cast<double>(total)));
+        target = std::max<uint64>(target, 1);
+
+        uint64 counted = 0;
+        for(size_t i = 0; i < sBucketCount; i++)
+        {
+            counted += mBuckets[i].load(std::memory_order_relaxed);
+            if(counted >= target)
+                return std::min(getBucketUpperBound(i), mMax.load(std::memory_order_relaxed));
+        }
+        return mMax.load(std::memory_order_relaxed);
+    }
+
+
+    SocketLatencySnapshot SocketLatencyHistogram::getSnapshot() const
+    {
+        SocketLatencySnapshot snapshot;
+        snapshot.mCount = mCount.load(std::memory_order_relaxed);
+        if(snapshot.mCount == 0)
+            return snapshot;
+
+        snapshot.mMean = mSum.load(std::memory_order_relaxed) / snapshot.mCount;
+        snapshot.mMax = mMax.load(std::memory_order_relaxed);
+        snapshot.mP50 = getPercentile(0.5);
+        snapshot.mP90 = getPercentile(0.9);
+        snapshot.mP99 = getPercentile(0.99);
+        snapshot.mP999 = getPercentile(0.999);
+        return snapshot;
+    }
+
+
+    void SocketLatencyHistogram::reset()
+    {
+        for(auto& bucket : mBuckets)
+            bucket.store(0, std::memory_order_relaxed);
+        mCount.store(0, std::memory_order_relaxed);
+        mSum.store(0, std::memory_order_relaxed);
+        mMax.store(0, std::memory_order_relaxed);
+    }
+
+    //////////////////////////////////////////////////////////////////////////
+    // SocketMetrics
+    //////////////////////////////////////////////////////////////////////////
+
+    void SocketMetrics::recordSent(size_t bytes, uint64 enqueueTime)
+    {
+        mMessagesSent.fetch_add(1, std::memory_order_relaxed);
+        mBytesSent.fetch_add(bytes, std::memory_order_relaxed);
+        if(enqueueTime != 0)
+        {
+            uint64 time = now();
+            mSendLatency.record(time > enqueueTime ? time - enqueueTime : 0);
+        }
+    }
+
+
+    void SocketMetrics::recordReceived(size_t bytes)
+    {
+        mMessagesReceived.fetch_add(1, std::memory_order_relaxed);
+        mBytesReceived.fetch_add(bytes, std::memory_order_relaxed);
+    }
+
+
+    SocketMetricsSnapshot SocketMetrics::getSnapshot() const
+    {
+        SocketMetricsSnapshot snapshot;
+        snapshot.mMessagesSent = mMessagesSent.load(std::memory_order_relaxed);
+        snapshot.mBytesSent = mBytesSent.load(std::memory_order_relaxed);
+        snapshot.mMessagesReceived = mMessagesReceived.load(std::memory_order_relaxed);
+        snapshot.mBytesReceived = mBytesReceived.load(std::memory_order_relaxed);
+        snapshot.mMessagesDropped = mMessagesDropped.load(std::memory_order_relaxed);
+        snapshot.mConnectAttempts = mConnectAttempts.load(std::memory_order_relaxed);
+        snapshot.mConnects = mConnects.load(std::memory_order_relaxed);
+        snapshot.mDisconnects = mDisconnects.load(std::memory_order_relaxed);
+        snapshot.mSendLatency = mSendLatency.getSnapshot();
+        snapshot.mProcessDuration = mProcessDuration.getSnapshot();
+        return snapshot;
+    }
+
+
+    void SocketMetrics::reset()
+    {
+        mMessagesSent.store(0, std::memory_order_relaxed);
+        mBytesSent.store(0, std::memory_order_relaxed);
+        mMessagesReceived.store(0, std::memory_order_relaxed);
+        mBytesReceived.store(0, std::memory_order_relaxed);
+        mMessagesDropped.store(0, std::memory_order_relaxed);
+        mConnectAttempts.store(0, std::memory_order_relaxed);
+        mConnects.store(0, std::memory_order_relaxed);
+        mDisconnects.store(0, std::memory_order_relaxed);
+        mSendLatency.reset();
+        mProcessDuration.reset();
+    }
+
+
+    uint64 SocketMetrics::now()
+    {
+        auto time = std::chrono::steady_clock::now().time_since_epoch();
+        return static_cast<uint64>(std::chrono::duration_cast<std::chrono::nanoseconds>(time).count()) | 1;
+    }
+
+    //////////////////////////////////////////////////////////////////////////
+    // Snapshots
+    //////////////////////////////////////////////////////////////////////////
+
+    std::string SocketMetricsSnapshot::toString() const
+    {
+        return utility::stringFormat("sent %llu msgs %llu bytes, received %llu msgs %llu bytes, dropped %llu, "
+                                     "connects %llu, connect attempts %llu, disconnects %llu, queued %zu msgs %zu bytes, send latency %s, process %s",
+            static_cast<unsigned long long>(mMessagesSent), static_cast<unsigned long long>(mBytesSent),
+            static_cast<unsigned long long>(mMessagesReceived), static_cast<unsigned long long>(mBytesReceived),
+            static_cast<unsigned long long>(mMessagesDropped), static_cast<unsigned long long>(mConnects),
+            static_cast<unsigned long long>(mConnectAttempts), static_cast<unsigned long long>(mDisconnects),
+            mQueueDepth.mMessages, mQueueDepth.mBytes,
+            formatLatency(mSendLatency).c_str(), formatLatency(mProcessDuration).c_str());
+    }
+
+
+    std::string SocketThreadMetricsSnapshot::toString() const
+    {
+        return utility::stringFormat("%zu adapters, %llu passes, pass %s", mAdapterCount,
+            static_cast<unsigned long long>(mPassDuration.mCount), formatLatency(mPassDuration).c_str());
+    }
+}
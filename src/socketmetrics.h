@@ -0,0 +1,183 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#pragma once
+
+// External includes
+#include <nap/numeric.h>
+#include <array>
+#include <atomic>
+#include <string>
+
+// Local includes
+#include "socketsendqueue.h"
+
+namespace nap
+{
+    //////////////////////////////////////////////////////////////////////////
+
+    /**
+     * Summary of a SocketLatencyHistogram, all durations are in nanoseconds
+     */
+    struct NAPAPI SocketLatencySnapshot
+    {
+        uint64 mCount   = 0;    ///< number of recorded durations
+        uint64 mMean    = 0;    ///< mean duration
+        uint64 mMax     = 0;    ///< longest duration
+        uint64 mP50     = 0;    ///< median duration
+        uint64 mP90     = 0;    ///< 90th percentile
+        uint64 mP99     = 0;    ///< 99th percentile
+        uint64 mP999    = 0;    ///< 99.9th percentile
+    };
+
+
+    /**
+     * Lock-free histogram of durations with logarithmic buckets, in the style of an HDR histogram. Every power of two
+     * is split in 8 linear sub-buckets, so percentiles are reported with a relative error of at most 12.5% over the
+     * full 64 bit range. Recording is a handful of relaxed atomic increments and can be done from any thread.
+     */
+    class NAPAPI SocketLatencyHistogram final
+    {
+    public:
+        static constexpr int    sSubBucketBits  = 3;
+        static constexpr size_t sSubBucketCount = size_t(1) << sSubBucketBits;
+        static constexpr size_t sBucketCount    = (64 - sSubBucketBits + 1) * sSubBucketCount;
+
+        /**
+         * Records a duration. Thread-safe
+         * @param nanos the duration in nanoseconds
+         */
+        void record(uint64 nanos);
+
+        /**
+         * Returns the duration below which the given fraction of the recorded durations fall. Thread-safe
+         * @param percentile fraction between 0 and 1
+         * @return upper bound of the bucket holding the percentile in nanoseconds, 0 when nothing is recorded
+         */
+        uint64 getPercentile(double percentile) const;
+
+        /**
+         * @return summary of the recorded durations. Thread-safe
+         */
+        SocketLatencySnapshot getSnapshot() const;
+
+        /**
+         * Discards all recorded durations. Durations recorded concurrently might partially survive
+         */
+        void reset();
+
+        /**
+         * @return bucket the value is counted in
+         */
+        static size_t getBucket(uint64 value);
+
+        /**
+         * @return highest value counted in the bucket
+         */
+        static uint64 getBucketUpperBound(size_t bucket);
+    private:
+        std::array<std::atomic<uint64>, sBucketCount>   mBuckets = {};
+        std::atomic<uint64>                             mCount = { 0 };
+        std::atomic<uint64>                             mSum = { 0 };
+        std::atomic<uint64>                             mMax = { 0 };
+    };
+
+
+    /**
+     * Snapshot of the SocketMetrics of a SocketAdapter
+     */
+    struct NAPAPI SocketMetricsSnapshot
+    {
+        uint64                  mMessagesSent       = 0;    ///< number of messages handed to the kernel or shared memory
+        uint64                  mBytesSent          = 0;    ///< payload bytes of the sent messages
+        uint64                  mMessagesReceived   = 0;    ///< number of dispatched messages
+        uint64                  mBytesReceived      = 0;    ///< payload bytes of the dispatched messages
+        uint64                  mMessagesDropped    = 0;    ///< number of messages dropped by the queue overflow policy
+        uint64                  mConnectAttempts    = 0;    ///< number of connection attempts, including reconnects
+        uint64                  mConnects           = 0;    ///< number of established connections
+        uint64                  mDisconnects        = 0;    ///< number of closed connections
+        SocketQueueDepth        mQueueDepth;                ///< messages and bytes waiting to be sent, summed over all sockets
+        SocketLatencySnapshot   mSendLatency;               ///< time between queueing and sending a message
+        SocketLatencySnapshot   mProcessDuration;           ///< duration of the process() calls, near 0 for adapters that handle their sockets in asio handlers, like SocketServer
+
+        /**
+         * @return single line summary, used when metrics are logged periodically
+         */
+        std::string toString() const;
+    };
+
+
+    /**
+     * Snapshot of the metrics of a SocketThread
+     */
+    struct NAPAPI SocketThreadMetricsSnapshot
+    {
+        size_t                  mAdapterCount = 0;          ///< number of registered adapters
+        SocketLatencySnapshot   mPassDuration;              ///< duration of processing all adapters, or a single adapter on request when EVENT_DRIVEN
+
+        /**
+         * @return single line summary, used when metrics are logged periodically
+         */
+        std::string toString() const;
+    };
+
+
+    /**
+     * Lock-free counters and latency histograms of a single SocketAdapter. Written by the threads handling the
+     * adapter and readable from any thread.
+     */
+    class NAPAPI SocketMetrics final
+    {
+    public:
+        /**
+         * Records a message handed to the kernel
+         * @param bytes payload size in bytes
+         * @param enqueueTime time the message was queued, see now(). 0 skips the send latency
+         */
+        void recordSent(size_t bytes, uint64 enqueueTime);
+
+        /**
+         * Records a dispatched message
+         * @param bytes payload size in bytes
+         */
+        void recordReceived(size_t bytes);
+
+        void recordDropped()                    { mMessagesDropped.fetch_add(1, std::memory_order_relaxed); }
+        void recordConnectAttempt()             { mConnectAttempts.fetch_add(1, std::memory_order_relaxed); }
+        void recordConnect()                    { mConnects.fetch_add(1, std::memory_order_relaxed); }
+        void recordDisconnect()                 { mDisconnects.fetch_add(1, std::memory_order_relaxed); }
+
+        /**
+         * Records the duration of a process() call
+         * @param nanos the duration in nanoseconds
+         */
+        void recordProcess(uint64 nanos)        { mProcessDuration.record(nanos); }
+
+        /**
+         * @return snapshot of all counters, the queue depth is left empty. Thread-safe
+         */
+        SocketMetricsSnapshot getSnapshot() const;
+
+        /**
+         * Resets all counters and histograms
+         */
+        void reset();
+
+        /**
+         * @return monotonic time in nanoseconds, never 0
+         */
+        static uint64 now();
+    private:
+        std::atomic<uint64>     mMessagesSent = { 0 };
+        std::atomic<uint64>     mBytesSent = { 0 };
+        std::atomic<uint64>     mMessagesReceived = { 0 };
+        std::atomic<uint64>     mBytesReceived = { 0 };
+        std::atomic<uint64>     mMessagesDropped = { 0 };
+        std::atomic<uint64>     mConnectAttempts = { 0 };
+        std::atomic<uint64>     mConnects = { 0 };
+        std::atomic<uint64>     mDisconnects = { 0 };
+        SocketLatencyHistogram  mSendLatency;
+        SocketLatencyHistogram  mProcessDuration;
+    };
+}
@@ -0,0 +1,120 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#include "socketpayload.h"
+#include "socketbufferpool.h"
+
+// External includes
+#include <cstring>
+#include <new>
+#include <utility>
+
+namespace nap
+{
+    //////////////////////////////////////////////////////////////////////////
+    // SocketPayload
+    //////////////////////////////////////////////////////////////////////////
+
+    SocketPayload::SocketPayload(const std::string& data) :
+        SocketPayload(data.data(), data.size())
+    {
+    }
+
+
+    SocketPayload::SocketPayload(const char* data, size_t size)
+    {
+        size_t capacity = 0;
+        char* block = SocketBufferPool::get().acquire(sizeof(Storage) + size, capacity);
+        mStorage = new (block) Storage();
+        mStorage->mSize = size;
+        mStorage->mCapacity = capacity;
+        if(size > 0)
+            std::memcpy(block + sizeof(Storage), data, size);
+    }
+
+
+    SocketPayload::~SocketPayload()
+    {
+        release();
+    }
+
+
+    SocketPayload::SocketPayload(const SocketPayload& other) :
+        mStorage(other.mStorage)
+    {
+        if(mStorage != nullptr)
+            mStorage->mReferences.fetch_add(1, std::memory_order_relaxed);
+    }
+
+
+    SocketPayload::SocketPayload(SocketPayload&& other) noexcept :
+        mStorage(other.mStorage)
+    {
+        other.mStorage = nullptr;
+    }
+
+
+    SocketPayload& SocketPayload::operator=(const SocketPayload& other)
+    {
+        if(mStorage != other.mStorage)
+        {
+            release();
+            mStorage = other.mStorage;
+            if(mStorage != nullptr)
+                mStorage->mReferences.fetch_add(1, std::memory_order_relaxed);
+        }
+        return *this;
+    }
+
+
+    SocketPayload& SocketPayload::operator=(SocketPayload&& other) noexcept
+    {
+        if(this != &other)
+        {
+            release();
+            mStorage = other.mStorage;
+            other.mStorage = nullptr;
+        }
+        return *this;
+    }
+
+
+    void SocketPayload::release()
+    {
+        if(mStorage == nullptr)
+            return;
+
+        if(mStorage->mReferences.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        {
+            size_t capacity = mStorage->mCapacity;
+            mStorage->~Storage();
+            SocketBufferPool::get().release(reinterpret_cast<char*>(mStorage), capacity);
+        }
+        mStorage = nullptr;
+    }
+
+
+    const char* SocketPayload::data() const
+    {
+        return mStorage != nullptr ? reinterpret_cast<const char*>(mStorage) + sizeof(Storage) : nullptr;
+    }
+
+
+    size_t SocketPayload::size() const
+    {
+        return mStorage != nullptr ? mStorage->mSize : 0;
+    }
+
+
+    bool SocketPayload::empty() const
+    {
+        return size() == 0;
+    }
+
+
+    asio::const_buffer SocketPayload::buffer() const
+    {
+        return asio::buffer(data(), size());
+    }
+}
@@ -0,0 +1,90 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#pragma once
+
+// External includes
+#include <nap/numeric.h>
+#include <atomic>
+#include <string>
+
+// ASIO includes
+#include <asio/ts/buffer.hpp>
+
+namespace nap
+{
+    //////////////////////////////////////////////////////////////////////////
+
+    /**
+     * Immutable, reference counted message data. Copying a SocketPayload only copies a handle to the data,
+     * which allows a single message to be queued for many connections without copying it per connection.
+     * The data lives in a block of the SocketBufferPool together with its reference count, so creating a payload does
+     * not allocate once the pool is warmed up. The block is returned when the last SocketPayload referring to it is destroyed.
+     */
+    class NAPAPI SocketPayload final
+    {
+    public:
+        /**
+         * Creates an empty payload
+         */
+        SocketPayload() = default;
+
+        /**
+         * Creates a payload holding a copy of the given data
+         * @param data the data to copy
+         */
+        explicit SocketPayload(const std::string& data);
+
+        /**
+         * Creates a payload holding a copy of the given data
+         * @param data pointer to the data to copy
+         * @param size size of the data in bytes
+         */
+        SocketPayload(const char* data, size_t size);
+
+        ~SocketPayload();
+
+        SocketPayload(const SocketPayload& other);
+        SocketPayload(SocketPayload&& other) noexcept;
+        SocketPayload& operator=(const SocketPayload& other);
+        SocketPayload& operator=(SocketPayload&& other) noexcept;
+
+        /**
+         * @return pointer to the data, nullptr when empty
+         */
+        const char* data() const;
+
+        /**
+         * @return size of the data in bytes
+         */
+        size_t size() const;
+
+        /**
+         * @return whether the payload holds no data
+         */
+        bool empty() const;
+
+        /**
+         * @return asio buffer referring to the data, valid as long as this payload or a copy of it exists
+         */
+        asio::const_buffer buffer() const;
+    private:
+        /**
+         * Header placed in front of the data in the pooled block
+         */
+        struct Storage
+        {
+            std::atomic<uint32>     mReferences = { 1 };
+            size_t                  mSize = 0;
+            size_t                  mCapacity = 0;  ///< capacity of the pooled block, including this header
+        };
+
+        /**
+         * Drops the reference to the storage, returns the block to the pool when it was the last one
+         */
+        void release();
+
+        Storage* mStorage = nullptr;
+    };
+}
@@ -0,0 +1,78 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#include "socketreceivebuffer.h"
+
+// External includes
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+namespace nap
+{
+    //////////////////////////////////////////////////////////////////////////
+    // SocketReceiveBuffer
+    //////////////////////////////////////////////////////////////////////////
+
+    SocketReceiveBuffer::SocketReceiveBuffer(size_t capacity)
+    {
+        if(capacity > 0)
+            mBuffer = SocketBuffer(capacity);
+    }
+
+
+    asio::mutable_buffer SocketReceiveBuffer::prepare(size_t size)
+    {
+        if(mBuffer.capacity() - mWritePosition < size)
+        {
+            // move the partially received message to the start, grow when it still doesn't fit
+            size_t pending = this->size();
+            if(mReadPosition > 0)
+            {
+                std::memmove(mBuffer.data(), mBuffer.data() + mReadPosition, pending);
+                mReadPosition = 0;
+                mWritePosition = pending;
+            }
+
+            // grow geometrically, messages larger than the buffer are received in many reads
+            if(mBuffer.capacity() - mWritePosition < size)
+            {
+                SocketBuffer grown(std::max(mWritePosition + size, mBuffer.capacity() * 2));
+                if(mWritePosition > 0)
+                    std::memcpy(grown.data(), mBuffer.data(), mWritePosition);
+                mBuffer = std::move(grown);
+            }
+        }
+
+        return asio::buffer(mBuffer.data() + mWritePosition, mBuffer.capacity() - mWritePosition);
+    }
+
+
+    void SocketReceiveBuffer::commit(size_t size)
+    {
+        assert(mWritePosition + size <= mBuffer.capacity());
+        mWritePosition += size;
+    }
+
+
+    void SocketReceiveBuffer::consume(size_t size)
+    {
+        assert(mReadPosition + size <= mWritePosition);
+        mReadPosition += size;
+
+        // rewind when all data is consumed, nothing needs to be moved
+        if(mReadPosition == mWritePosition)
+        {
+            mReadPosition = 0;
+            mWritePosition = 0;
+        }
+    }
+
+
+    void SocketReceiveBuffer::clear()
+    {
+        mReadPosition = 0;
+        mWritePosition = 0;
+    }
+}
@@ -0,0 +1,81 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#pragma once
+
+// External includes
+#include <nap/numeric.h>
+
+// ASIO includes
+#include <asio/ts/buffer.hpp>
+
+// Local includes
+#include "socketbufferpool.h"
+
+namespace nap
+{
+    //////////////////////////////////////////////////////////////////////////
+
+    /**
+     * Receive buffer with separate read and write cursors. Sockets read into the contiguous free space after the write
+     * cursor, messages are parsed in place from the read cursor. When both cursors meet they are reset to the start of
+     * the buffer, so in the common case no data is moved at all. Only when a partially received message does not fit
+     * in the remaining space, the unconsumed bytes are moved to the start of the buffer. The buffer grows geometrically
+     * when a message is larger than the buffer itself. The storage is drawn from the SocketBufferPool.
+     * The buffer is linear, not a ring: the bytes of a partially received message can be moved by compaction and copied
+     * again when the buffer grows. Messages up to the receive size arrive in one piece and are never moved.
+     */
+    class NAPAPI SocketReceiveBuffer final
+    {
+    public:
+        /**
+         * Creates a receive buffer
+         * @param capacity initial capacity in bytes
+         */
+        explicit SocketReceiveBuffer(size_t capacity = 0);
+
+        /**
+         * Returns a contiguous writable region of at least the given size after the write cursor
+         * @param size minimum number of bytes to write
+         * @return the writable region
+         */
+        asio::mutable_buffer prepare(size_t size);
+
+        /**
+         * Moves the write cursor after writing to the region returned by prepare()
+         * @param size number of bytes written
+         */
+        void commit(size_t size);
+
+        /**
+         * Moves the read cursor after parsing data
+         * @param size number of bytes consumed
+         */
+        void consume(size_t size);
+
+        /**
+         * Discards all data
+         */
+        void clear();
+
+        /**
+         * @return pointer to the first unconsumed byte
+         */
+        const char* data() const                        { return mBuffer.data() + mReadPosition; }
+
+        /**
+         * @return number of unconsumed bytes
+         */
+        size_t size() const                             { return mWritePosition - mReadPosition; }
+
+        /**
+         * @return total capacity in bytes
+         */
+        size_t capacity() const                         { return mBuffer.capacity(); }
+    private:
+        SocketBuffer        mBuffer;
+        size_t              mReadPosition = 0;
+        size_t              mWritePosition = 0;
+    };
+}
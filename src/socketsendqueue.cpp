@@ -0,0 +1,182 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#include "socketsendqueue.h"
+#include "socketmetrics.h"
+
+// External includes
+#include <rtti/typeinfo.h>
+#include <chrono>
+
+RTTI_BEGIN_ENUM(nap::ESocketQueueOverflowPolicy)
+    RTTI_ENUM_VALUE(nap::ESocketQueueOverflowPolicy::DROP_OLDEST,   "Drop Oldest"),
+    RTTI_ENUM_VALUE(nap::ESocketQueueOverflowPolicy::DROP_NEWEST,   "Drop Newest"),
+    RTTI_ENUM_VALUE(nap::ESocketQueueOverflowPolicy::BLOCK,         "Block"),
+    RTTI_ENUM_VALUE(nap::ESocketQueueOverflowPolicy::DISCONNECT,    "Disconnect")
+RTTI_END_ENUM
+
+namespace nap
+{
+    //////////////////////////////////////////////////////////////////////////
+    // SocketSendQueue
+    //////////////////////////////////////////////////////////////////////////
+
+    void SocketQueuedMessage::complete(const asio::error_code& errorCode)
+    {
+        if(mCallback == nullptr)
+            return;
+
+        auto callback = std::move(mCallback);
+        mCallback = nullptr;
+        callback(errorCode);
+    }
+
+
+    ESocketQueueResult SocketSendQueue::push(SocketQueuedMessage message, bool allowBlock)
+    {
+        size_t size = message.mPayload.size();
+        if(!reserve(size))
+        {
+            bool queued = false;
+            switch(mLimits.mPolicy)
+            {
+            case ESocketQueueOverflowPolicy::DROP_OLDEST:
+            {
+                // drop queued messages until the new one fits, the queue is only ordered per producing thread
+                SocketQueuedMessage dropped;
+                while(fits(size) && !queued && pop(dropped))
+                {
+                    mDropped.fetch_add(1, std::memory_order_relaxed);
+                    if(mMetrics != nullptr)
+                        mMetrics->recordDropped();
+                    dropped.complete(asio::error::no_buffer_space);
+                    queued = reserve(size);
+                }
+                break;
+            }
+            case ESocketQueueOverflowPolicy::BLOCK:
+            {
+                if(!allowBlock || !fits(size))
+                    break;
+
+                // pop() wakes us up every time room is made
+                auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(mLimits.mBlockTimeoutMillis);
+                std::unique_lock lock(mBlockMutex);
+                mBlockedSenders.fetch_add(1);
+                queued = mBlockCondition.wait_until(lock, deadline, [this, size]() { return reserve(size); });
+                mBlockedSenders.fetch_sub(1);
+                break;
+            }
+            case ESocketQueueOverflowPolicy::DROP_NEWEST:
+            case ESocketQueueOverflowPolicy::DISCONNECT:
+                break;
+            }
+
+            if(!queued)
+            {
+                mDropped.fetch_add(1, std::memory_order_relaxed);
+                if(mMetrics != nullptr)
+                    mMetrics->recordDropped();
+                message.complete(asio::error::no_buffer_space);
+                return mLimits.mPolicy == ESocketQueueOverflowPolicy::DISCONNECT ? ESocketQueueResult::DISCONNECT : ESocketQueueResult::DROPPED;
+            }
+        }
+
+        if(mMetrics != nullptr)
+            message.mEnqueueTime = SocketMetrics::now();
+
+        mQueue.enqueue(std::move(message));
+        updateWritable();
+        return ESocketQueueResult::QUEUED;
+    }
+
+
+    bool SocketSendQueue::pop(SocketQueuedMessage& message)
+    {
+        if(!mQueue.try_dequeue(message))
+            return false;
+
+        mMessages.fetch_sub(1);
+        mBytes.fetch_sub(message.mPayload.size());
+        updateWritable();
+
+        // lock to make sure a blocked sender doesn't miss the notification between its check and wait
+        if(mBlockedSenders.load() > 0)
+        {
+            { std::lock_guard lock(mBlockMutex); }
+            mBlockCondition.notify_all();
+        }
+        return true;
+    }
+
+
+    void SocketSendQueue::clear()
+    {
+        SocketQueuedMessage message;
+        while(pop(message))
+            message.complete(asio::error::operation_aborted);
+    }
+
+
+    SocketQueueDepth SocketSendQueue::getDepth() const
+    {
+        SocketQueueDepth depth;
+        depth.mMessages = mMessages.load(std::memory_order_relaxed);
+        depth.mBytes = mBytes.load(std::memory_order_relaxed);
+        return depth;
+    }
+
+
+    bool SocketSendQueue::reserve(size_t size)
+    {
+        size_t messages = mMessages.fetch_add(1) + 1;
+        size_t bytes = mBytes.fetch_add(size) + size;
+        if((mLimits.mMaxMessages > 0 && messages > static_cast<size_t>(mLimits.mMaxMessages)) ||
+           (mLimits.mMaxBytes > 0 && bytes > static_cast<size_t>(mLimits.mMaxBytes)))
+        {
+            mMessages.fetch_sub(1);
+            mBytes.fetch_sub(size);
+            return false;
+        }
+        return true;
+    }
+
+
+    void SocketSendQueue::setWritabilityCallback(std::function<void(bool)> function)
+    {
+        std::lock_guard lock(mWritabilityMutex);
+        mWritabilityCallback = std::move(function);
+    }
+
+
+    void SocketSendQueue::updateWritable()
+    {
+        if(mLimits.mHighWatermarkBytes <= 0)
+            return;
+
+        // retry until the state matches the byte count, a concurrent push or pop might change both in between
+        while(true)
+        {
+            bool writable = mWritable.load();
+            size_t bytes = mBytes.load();
+            bool should_be_writable = writable ? bytes <= static_cast<size_t>(mLimits.mHighWatermarkBytes) :
+                                                 bytes <= static_cast<size_t>(mLimits.mLowWatermarkBytes);
+            if(writable == should_be_writable)
+                return;
+
+            if(mWritable.compare_exchange_strong(writable, should_be_writable))
+            {
+                std::lock_guard lock(mWritabilityMutex);
+                if(mWritabilityCallback != nullptr)
+                    mWritabilityCallback(should_be_writable);
+            }
+        }
+    }
+
+
+    bool SocketSendQueue::fits(size_t size) const
+    {
+        return mLimits.mMaxBytes <= 0 || size <= static_cast<size_t>(mLimits.mMaxBytes);
+    }
+}
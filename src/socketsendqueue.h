@@ -0,0 +1,205 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#pragma once
+
+// External includes
+#include <nap/numeric.h>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+
+// ASIO includes
+#include <asio/system_error.hpp>
+
+// NAP includes
+#include <concurrentqueue.h>
+
+// Local includes
+#include "socketpayload.h"
+
+namespace nap
+{
+    // forward declares
+    class SocketMetrics;
+
+    //////////////////////////////////////////////////////////////////////////
+
+    /**
+     * What happens when a message is sent to a full outgoing queue
+     */
+    enum class ESocketQueueOverflowPolicy : int
+    {
+        DROP_OLDEST     = 0,    ///< queued messages are dropped to make room, oldest first per sending thread. With multiple sending threads a newer message of another thread might be dropped
+        DROP_NEWEST     = 1,    ///< the sent message is dropped
+        BLOCK           = 2,    ///< the sender blocks until there is room or the timeout expires, the message is dropped on timeout
+        DISCONNECT      = 3     ///< the sent message is dropped and the slow consumer is disconnected
+    };
+
+
+    /**
+     * Result of pushing a message to a SocketSendQueue
+     */
+    enum class ESocketQueueResult : int
+    {
+        QUEUED          = 0,    ///< the message is queued
+        DROPPED         = 1,    ///< the message is dropped
+        DISCONNECT      = 2     ///< the message is dropped and the consumer must be disconnected, see ESocketQueueOverflowPolicy::DISCONNECT
+    };
+
+
+    /**
+     * Called once a sent message is handed to the kernel, or failed to be. The error code is empty on success,
+     * asio::error::no_buffer_space when the message is dropped by the overflow policy and asio::error::operation_aborted
+     * when the message is discarded because the connection closed
+     */
+    using SocketSendCallback = std::function<void(const asio::error_code&)>;
+
+
+    /**
+     * Message in a SocketSendQueue with its optional completion callback
+     */
+    struct NAPAPI SocketQueuedMessage
+    {
+        SocketPayload       mPayload;
+        SocketSendCallback  mCallback;
+        uint64              mEnqueueTime = 0;   ///< time the message was queued, see SocketMetrics::now(), 0 when metrics are disabled
+
+        /**
+         * Invokes and releases the completion callback, does nothing when there is no callback
+         * @param errorCode result of sending the message
+         */
+        void complete(const asio::error_code& errorCode);
+    };
+
+
+    /**
+     * Limits of a SocketSendQueue
+     */
+    struct NAPAPI SocketQueueLimits
+    {
+        int                         mMaxMessages = 0;                                   ///< maximum number of queued messages, 0 is unlimited
+        int                         mMaxBytes = 0;                                      ///< maximum number of queued payload bytes, 0 is unlimited
+        ESocketQueueOverflowPolicy  mPolicy = ESocketQueueOverflowPolicy::DROP_OLDEST;  ///< what happens when the queue is full
+        int                         mBlockTimeoutMillis = 100;                          ///< maximum time a sender blocks with the BLOCK policy
+        int                         mHighWatermarkBytes = 0;                            ///< the queue becomes unwritable when it holds more bytes, 0 disables the watermarks
+        int                         mLowWatermarkBytes = 0;                             ///< the queue becomes writable again when it holds this many bytes or less
+    };
+
+
+    /**
+     * Number of messages and payload bytes in a SocketSendQueue
+     */
+    struct NAPAPI SocketQueueDepth
+    {
+        size_t mMessages    = 0;    ///< number of queued messages
+        size_t mBytes       = 0;    ///< number of queued payload bytes
+    };
+
+
+    /**
+     * Outgoing message queue of a socket, bounded in messages and payload bytes.
+     * Any thread can push messages, the thread writing to the socket pops them. The queue itself is lock-free, only
+     * senders blocked by the BLOCK policy wait on a condition variable.
+     * When watermarks are set the queue turns unwritable once it holds more bytes than the high watermark, and writable
+     * again once it drains to the low watermark. Senders can use this to throttle themselves before the limits are hit.
+     */
+    class NAPAPI SocketSendQueue final
+    {
+    public:
+        SocketSendQueue() = default;
+
+        /**
+         * Sets the limits of the queue, call before the queue is used
+         * @param limits the limits
+         */
+        void setLimits(const SocketQueueLimits& limits)             { mLimits = limits; }
+
+        /**
+         * Sets the function called when the queue crosses a watermark, with the new writable state. The function is
+         * called on the thread pushing or popping the message that crossed the watermark. Can be called while the
+         * queue is in use, once it returns the previous function is not running and won't be called anymore
+         * @param function the function to call, nullptr stops notifying
+         */
+        void setWritabilityCallback(std::function<void(bool)> function);
+
+        /**
+         * Sets the metrics the queue records to, messages are timestamped when queued and drops are counted.
+         * Call before the queue is used
+         * @param metrics the metrics, nullptr disables recording
+         */
+        void setMetrics(SocketMetrics* metrics)                     { mMetrics = metrics; }
+
+        /**
+         * Queues a message, applying the overflow policy when the queue is full. A message larger than the byte limit
+         * never fits and is handled as if the queue is full without dropping older messages. The completion callbacks
+         * of messages dropped by the overflow policy are invoked on the calling thread. Thread-safe
+         * @param message the message
+         * @param allowBlock whether the calling thread may block, when false the BLOCK policy drops the message instead.
+         * Must be false on the thread popping the messages
+         * @return whether the message is queued, dropped or the consumer must be disconnected
+         */
+        ESocketQueueResult push(SocketQueuedMessage message, bool allowBlock = true);
+
+        /**
+         * Dequeues the next message. Thread-safe
+         * @param message the dequeued message
+         * @return false when the queue is empty
+         */
+        bool pop(SocketQueuedMessage& message);
+
+        /**
+         * Drops all queued messages, their completion callbacks are invoked with asio::error::operation_aborted. Thread-safe
+         */
+        void clear();
+
+        /**
+         * @return false when the queue holds more bytes than the high watermark and did not drain to the low watermark
+         * since. Thread-safe
+         */
+        bool isWritable() const                                     { return mWritable.load(); }
+
+        /**
+         * @return number of queued messages and bytes. Thread-safe
+         */
+        SocketQueueDepth getDepth() const;
+
+        /**
+         * @return number of messages dropped because the queue was full. Thread-safe
+         */
+        uint64 getDroppedCount() const                              { return mDropped.load(std::memory_order_relaxed); }
+    private:
+        /**
+         * Reserves room for a message of the given size
+         * @return false when the message does not fit
+         */
+        bool reserve(size_t size);
+
+        /**
+         * @return whether a message of the given size can ever fit in the queue
+         */
+        bool fits(size_t size) const;
+
+        /**
+         * Updates the writable state to the current number of queued bytes
+         */
+        void updateWritable();
+
+        moodycamel::ConcurrentQueue<SocketQueuedMessage>  mQueue;
+        SocketQueueLimits                           mLimits;
+        std::atomic<size_t>                         mMessages = { 0 };
+        std::atomic<size_t>                         mBytes = { 0 };
+        std::atomic<uint64>                         mDropped = { 0 };
+        std::atomic_bool                            mWritable = { true };
+        std::function<void(bool)>                   mWritabilityCallback;
+        std::mutex                                  mWritabilityMutex;
+        SocketMetrics*                              mMetrics = nullptr;
+
+        // senders blocked by the BLOCK policy
+        std::mutex                                  mBlockMutex;
+        std::condition_variable                     mBlockCondition;
+        std::atomic<int>                            mBlockedSenders = { 0 };
+    };
+}
@@ -10,12 +10,17 @@
 #include <asio/ts/internet.hpp>
 #include <asio/io_service.hpp>
 #include <asio/system_error.hpp>
-#include <asio/streambuf.hpp>
 #include <nap/logger.h>
 
 #include <thread>
 #include <mathutils.h>
 
+#if defined(ASIO_HAS_LOCAL_SOCKETS) && (defined(__unix__) || defined(__APPLE__))
+#define NAPSOCKET_HAS_LOCAL_SOCKET_FILES
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 
 using asio::ip::address;
 using asio::ip::tcp;
@@ -23,11 +28,71 @@ using asio::ip::tcp;
 RTTI_BEGIN_CLASS(nap::SocketServer)
         RTTI_PROPERTY("Port",			&nap::SocketServer::mPort,			nap::rtti::EPropertyMetaData::Default)
         RTTI_PROPERTY("IP Address",		&nap::SocketServer::mIPAddress,	    nap::rtti::EPropertyMetaData::Default)
+        RTTI_PROPERTY("Transport",		&nap::SocketServer::mTransport,	    nap::rtti::EPropertyMetaData::Default)
+        RTTI_PROPERTY("Local Path",		&nap::SocketServer::mLocalPath,	    nap::rtti::EPropertyMetaData::Default)
         RTTI_PROPERTY("Enable Log",		&nap::SocketServer::mEnableLog,	    nap::rtti::EPropertyMetaData::Default)
+        RTTI_PROPERTY("Receive Buffer Size",	&nap::SocketServer::mReceiveBufferSize,	nap::rtti::EPropertyMetaData::Default)
+        RTTI_PROPERTY("Connection Labels",	&nap::SocketServer::mEnableConnectionLabels,	nap::rtti::EPropertyMetaData::Default)
+        RTTI_PROPERTY("Acceptor Count",	&nap::SocketServer::mAcceptorCount,	nap::rtti::EPropertyMetaData::Default)
 RTTI_END_CLASS
 
 namespace nap
 {
+#ifdef SO_REUSEPORT
+    /**
+     * SO_REUSEPORT socket option, implements the settable socket option requirements of asio
+     */
+    class ReusePortOption
+    {
+    public:
+        explicit ReusePortOption(bool enable) : mValue(enable ? 1 : 0)          { }
+
+        template<typename Protocol>
+        int level(const Protocol&) const                                        { return SOL_SOCKET; }
+
+        template<typename Protocol>
+        int name(const Protocol&) const                                         { return SO_REUSEPORT; }
+
+        template<typename Protocol>
+        const void* data(const Protocol&) const                                 { return &mValue; }
+
+        template<typename Protocol>
+        std::size_t size(const Protocol&) const                                 { return sizeof(mValue); }
+    private:
+        int mValue;
+    };
+#endif
+
+#ifdef NAPSOCKET_HAS_LOCAL_SOCKET_FILES
+    /**
+     * Removes the socket file left behind by a server that is no longer running. The file is only removed when it is
+     * a socket that refuses connections, anything else is left for bind() to report
+     * @param path path of the socket file
+     * @param errorState contains the error when the path exists but is not a socket, or another server listens on it
+     * @return false when the path can't be used
+     */
+    static bool removeStaleLocalSocket(const std::string& path, utility::ErrorState& errorState)
+    {
+        struct stat info;
+        if(stat(path.c_str(), &info) != 0)
+            return true;
+
+        if(!errorState.check(S_ISSOCK(info.st_mode), "Local Path %s exists and is not a socket", path.c_str()))
+            return false;
+
+        asio::io_service service;
+        asio::local::stream_protocol::socket probe(service);
+        asio::error_code err;
+        probe.connect(asio::local::stream_protocol::endpoint(path), err);
+        if(!errorState.check(err.operator bool(), "Local Path %s is in use by another server", path.c_str()))
+            return false;
+
+        if(err == asio::error::connection_refused)
+            unlink(path.c_str());
+        return true;
+    }
+#endif
+
     //////////////////////////////////////////////////////////////////////////
     // SocketServer
     //////////////////////////////////////////////////////////////////////////
@@ -38,28 +103,111 @@ namespace nap
         bool init_success = false;
         asio::error_code asio_error_code;
 
-        // try to create ip address
-        // when address property is left empty, bind to any local address
-        asio::ip::address address;
-        if (mIPAddress.empty())
+        // multiple acceptors share the port using SO_REUSEPORT, the kernel balances incoming connections over them
+        if(!errorState.check(mAcceptorCount > 0, "Acceptor Count must be at least 1"))
+            return false;
+
+        // an empty read completes right away, connections would spin reading nothing
+        if(!errorState.check(mReceiveBufferSize > 0, "Receive Buffer Size must be larger than 0"))
+            return false;
+
+        // sharded acceptors live on the workers, without workers they would all share the io_service of the thread
+        if(!errorState.check(mThread != nullptr, "Thread cannot be nullptr"))
+            return false;
+
+        if(!errorState.check(mAcceptorCount == 1 || mThread->mWorkerCount > 0, "Acceptor Count > 1 requires a SocketThread with a Worker Count of at least 1"))
+            return false;
+
+        mRemoteEndpoint = std::make_unique<SocketStreamProtocol::endpoint>();
+        if(mTransport != ESocketTransport::TCP)
         {
-            address = asio::ip::address_v4::any();
-        } else
+            if(!errorState.check(mAcceptorCount == 1, "Acceptor Count must be 1 for local sockets"))
+                return false;
+
+            if(!createLocalEndpoint(mLocalPath, *mRemoteEndpoint, errorState))
+                return false;
+
+#ifdef NAPSOCKET_HAS_LOCAL_SOCKET_FILES
+            // remove the socket file left behind by a previous server, binding fails otherwise
+            if(!isAbstractLocalPath(mLocalPath) && !removeStaleLocalSocket(mLocalPath, errorState))
+                return false;
+#endif
+        }else
         {
-            address = asio::ip::make_address(mIPAddress, asio_error_code);
+            // try to create ip address
+            // when address property is left empty, bind to any local address
+            asio::ip::address address;
+            if (mIPAddress.empty())
+            {
+                address = asio::ip::address_v4::any();
+            } else
+            {
+                address = asio::ip::make_address(mIPAddress, asio_error_code);
+                if (handleAsioError(asio_error_code, errorState, init_success))
+                    return init_success;
+            }
+
+            // create endpoint
+            *mRemoteEndpoint = tcp::endpoint(address, mPort);
+        }
+
+#ifndef SO_REUSEPORT
+        if(!errorState.check(mAcceptorCount == 1, "Acceptor Count > 1 requires SO_REUSEPORT, which is not supported on this platform"))
+            return false;
+#endif
+
+        // create acceptors, a single acceptor lives on the thread and distributes connections over the workers,
+        // sharded acceptors each live on a worker and handle their own connections
+        for(int i = 0; i < mAcceptorCount; i++)
+        {
+            auto acceptor = std::make_unique<Acceptor>();
+            acceptor->mIOService = mAcceptorCount > 1 ? &getWorkerIOService() : &getIOService();
+            acceptor->mAcceptor = std::make_unique<SocketStreamAcceptor>(*acceptor->mIOService);
+
+            acceptor->mAcceptor->open(mRemoteEndpoint->protocol(), asio_error_code);
             if (handleAsioError(asio_error_code, errorState, init_success))
                 return init_success;
-        }
 
+            if(mTransport == ESocketTransport::TCP)
+            {
+                acceptor->mAcceptor->set_option(asio::socket_base::reuse_address(true), asio_error_code);
+                if (handleAsioError(asio_error_code, errorState, init_success))
+                    return init_success;
+            }
+
+#ifdef SO_REUSEPORT
+            if(mAcceptorCount > 1)
+            {
+                acceptor->mAcceptor->set_option(ReusePortOption(true), asio_error_code);
+                if (handleAsioError(asio_error_code, errorState, init_success))
+                    return init_success;
+            }
+#endif
+
+            acceptor->mAcceptor->bind(*mRemoteEndpoint, asio_error_code);
+            if (handleAsioError(asio_error_code, errorState, init_success))
+                return init_success;
+
+            acceptor->mAcceptor->listen(asio::socket_base::max_listen_connections, asio_error_code);
+            if (handleAsioError(asio_error_code, errorState, init_success))
+                return init_success;
 
-        // create endpoint
-        mRemoteEndpoint = std::make_unique<tcp::endpoint>(address, mPort);
+            mAcceptors.emplace_back(std::move(acceptor));
+        }
 
-        // create acceptor and attach the acceptor callback
-        mAcceptor = std::make_unique<tcp::acceptor>(getIOService(), *mRemoteEndpoint.get());
+#ifdef NAPSOCKET_HAS_LOCAL_SOCKET_FILES
+        // remember the socket file we created, onDestroy() leaves it alone when another server replaced it
+        struct stat info;
+        if(mTransport != ESocketTransport::TCP && !isAbstractLocalPath(mLocalPath) && stat(mLocalPath.c_str(), &info) == 0)
+        {
+            mLocalPathDevice = static_cast<uint64>(info.st_dev);
+            mLocalPathInode = static_cast<uint64>(info.st_ino);
+        }
+#endif
 
-        // create new accepting socket
-        acceptNewSocket();
+        // create new accepting sockets
+        for(auto& acceptor : mAcceptors)
+            acceptNewSocket(*acceptor);
 
         // init the adapter
         if(!SocketAdapter::init(errorState))
@@ -69,7 +217,7 @@ namespace nap
     }
 
 
-    void SocketServer::handleAccept(const asio::error_code& errorCode)
+    void SocketServer::handleAccept(Acceptor& acceptor, const asio::error_code& errorCode)
     {
         bool error = errorCode.operator bool();
         asio::error_code error_code = errorCode;
@@ -79,32 +227,54 @@ namespace nap
             // log status
             logInfo("Socket connected");
 
-            // set no delay
-            mWaitingSocket->set_option(tcp::no_delay(mNoDelay), error_code);
+            // set no delay, local sockets don't buffer small writes
+            if(mTransport == ESocketTransport::TCP)
+                acceptor.mWaitingConnection->mSocket->set_option(tcp::no_delay(mNoDelay), error_code);
+            // wake ups for shared memory clients are sent without blocking
+            if(!error_code && mTransport == ESocketTransport::SHARED_MEMORY)
+                acceptor.mWaitingConnection->mSocket->non_blocking(true, error_code);
+
             bool error = error_code.operator bool();
             if(!error)
             {
                 // read all available bytes, this is to make sure socket stream is empty before we start receiving new data
-                size_t available = mWaitingSocket->available();
-                asio::streambuf receivedStreamBuffer;
-                asio::streambuf::mutable_buffers_type bufs = receivedStreamBuffer.prepare(available);
+                // the handshake of a shared memory client might already be received and is kept
                 asio::error_code err;
-                mWaitingSocket->receive(bufs, asio::socket_base::message_end_of_record, err);
+                size_t available = mTransport != ESocketTransport::SHARED_MEMORY ? acceptor.mWaitingConnection->mSocket->available(err) : 0;
+                if(available > 0)
+                {
+                    SocketBuffer discard_buffer(available);
+                    acceptor.mWaitingConnection->mSocket->receive(asio::buffer(discard_buffer.data(), available), asio::socket_base::message_end_of_record, err);
+                }
                 if (err)
                 {
                     logError(err.message());
                 }
 
-                // create new message queue
-                std::string socket_id = math::generateUUID();
-                mMessageQueue.emplace(socket_id, moodycamel::ConcurrentQueue<std::string>());
-                mSockets.emplace(socket_id, std::move(mWaitingSocket));
+                // register connection
+                auto connection = std::move(acceptor.mWaitingConnection);
+                if(mEnableConnectionLabels)
+                    connection->mID = math::generateUUID();
+                {
+                    std::lock_guard lock(mConnectionMutex);
+                    addConnection(connection);
+                }
 
                 // create new accepting socket
-                acceptNewSocket();
+                acceptNewSocket(acceptor);
+
+                if(auto* metrics = getEnabledMetrics())
+                    metrics->recordConnect();
 
-                // dispatch signal
-                socketConnected.trigger(socket_id);
+                // dispatch signals
+                deliver(SocketEvent(static_cast<int>(EEvent::OPENED), connection->mHandle, connection->mID.data(), connection->mID.size()));
+
+                // start receiving on the thread handling the connection
+                asio::post(*connection->mIOService, [this, connection]()
+                {
+                    if(!connection->mClosed.load())
+                        readNext(connection);
+                });
             }
         }
 
@@ -114,7 +284,7 @@ namespace nap
             logError(error_code.message());
 
             // create new accepting socket
-            acceptNewSocket();
+            acceptNewSocket(acceptor);
         }
     }
 
@@ -123,38 +293,116 @@ namespace nap
     {
         SocketAdapter::onDestroy();
 
-        // shutdown sockets
-        for(auto& pair : mSockets)
+        // stop accepting new connections, on the thread handling the acceptor
+        for(auto& acceptor : mAcceptors)
+        {
+            auto* tcp_acceptor = acceptor->mAcceptor.get();
+            executeOnIOService(*acceptor->mIOService, [tcp_acceptor]()
+            {
+                asio::error_code asio_error_code;
+                tcp_acceptor->close(asio_error_code);
+            });
+        }
+
+        std::vector<ConnectionSlot> connections;
         {
-            asio::error_code asio_error_code;
-            pair.second->shutdown(asio::socket_base::shutdown_both,asio_error_code);
+            std::lock_guard lock(mConnectionMutex);
+            std::swap(connections, mConnectionSlots);
+            mFreeConnectionSlots.clear();
+            mConnectionLabels.clear();
+            mConnectionCount = 0;
+        }
 
-            // log any errors
-            if (asio_error_code)
+        // shutdown sockets, on the thread handling the connection
+        for(auto& slot : connections)
+        {
+            auto connection = slot.mConnection;
+            if(connection == nullptr)
+                continue;
+
+            // stop posting writable state changes, the handlers posted before return on the closed connection
+            connection->mClosed.store(true);
+            connection->mQueue.setWritabilityCallback(nullptr);
+            executeOnIOService(*connection->mIOService, [connection]()
             {
-                logError(asio_error_code.message());
-            }
+                asio::error_code asio_error_code;
+                connection->mSocket->shutdown(asio::socket_base::shutdown_both, asio_error_code);
+                connection->mSocket->close(asio_error_code);
+            });
         }
 
-        mSockets.clear();
+        // make sure no other thread is still handling one of our connections
+        waitForHandlers();
+
+        // discard queued messages, notifying their senders
+        for(auto& slot : connections)
+        {
+            if(slot.mConnection == nullptr)
+                continue;
+
+            closeSharedChannel(*slot.mConnection);
+            slot.mConnection->mQueue.clear();
+        }
+
+#ifdef NAPSOCKET_HAS_LOCAL_SOCKET_FILES
+        // remove the socket file, only when it is still the one this server bound
+        struct stat info;
+        if(mLocalPathInode != 0 && stat(mLocalPath.c_str(), &info) == 0 &&
+           static_cast<uint64>(info.st_dev) == mLocalPathDevice && static_cast<uint64>(info.st_ino) == mLocalPathInode)
+        {
+            unlink(mLocalPath.c_str());
+        }
+        mLocalPathInode = 0;
+#endif
     }
 
 
     void SocketServer::sendToAll(const std::string &message)
     {
-        for(auto& pair : mMessageQueue)
+        sendToAll(SocketPayload(message));
+    }
+
+
+    void SocketServer::sendToAll(const SocketPayload& payload)
+    {
+        // queue outside of the lock, a full queue might block the sender. The list is local, dropping a queued
+        // message completes its send callback, which might call sendToAll again
+        std::vector<std::shared_ptr<Connection>> connections;
         {
-            pair.second.enqueue(message);
+            std::lock_guard lock(mConnectionMutex);
+            connections.reserve(mConnectionCount);
+            for(auto& slot : mConnectionSlots)
+            {
+                if(slot.mConnection != nullptr)
+                    connections.emplace_back(slot.mConnection);
+            }
         }
+
+        for(auto& connection : connections)
+            enqueue(connection, { payload, nullptr });
     }
 
 
     void SocketServer::send(const std::string &id, const std::string &message)
     {
-        auto itr = mMessageQueue.find(id);
-        if(itr!=mMessageQueue.end())
+        send(id, SocketPayload(message));
+    }
+
+
+    void SocketServer::send(const std::string &id, const SocketPayload& payload)
+    {
+        std::shared_ptr<Connection> connection;
+        {
+            std::lock_guard lock(mConnectionMutex);
+            auto itr = mConnectionLabels.find(id);
+            const auto* slot = itr != mConnectionLabels.end() ? findConnection(itr->second) : nullptr;
+            if(slot != nullptr)
+                connection = slot->mConnection;
+        }
+
+        if(connection != nullptr)
         {
-            itr->second.enqueue(message);
+            enqueue(connection, { payload, nullptr });
         }else
         {
             logError(utility::stringFormat("Cannot send message to socket, id %s not found!", id.c_str()));
@@ -162,27 +410,167 @@ namespace nap
     }
 
 
-    bool SocketServer::handleError(const std::string& id, asio::error_code& errorCode)
+    void SocketServer::send(SocketConnectionHandle handle, const std::string& message)
+    {
+        send(handle, SocketPayload(message));
+    }
+
+
+    void SocketServer::send(SocketConnectionHandle handle, const SocketPayload& payload)
+    {
+        send(handle, payload, nullptr);
+    }
+
+
+    ESocketQueueResult SocketServer::send(SocketConnectionHandle handle, const std::string& message, SocketSendCallback callback)
+    {
+        return send(handle, SocketPayload(message), std::move(callback));
+    }
+
+
+    ESocketQueueResult SocketServer::send(SocketConnectionHandle handle, const SocketPayload& payload, SocketSendCallback callback)
+    {
+        std::shared_ptr<Connection> connection;
+        {
+            std::lock_guard lock(mConnectionMutex);
+            const auto* slot = findConnection(handle);
+            if(slot != nullptr)
+                connection = slot->mConnection;
+        }
+
+        if(connection == nullptr)
+        {
+            logError(utility::stringFormat("Cannot send message to connection, handle %llu not found!", static_cast<unsigned long long>(handle)));
+            if(callback != nullptr)
+                callback(asio::error::not_connected);
+            return ESocketQueueResult::DROPPED;
+        }
+
+        return enqueue(connection, { payload, std::move(callback) });
+    }
+
+
+    ESocketQueueResult SocketServer::enqueue(const std::shared_ptr<Connection>& connection, SocketQueuedMessage message)
+    {
+        auto result = connection->mQueue.push(std::move(message), canBlockSender(*connection->mIOService));
+        switch(result)
+        {
+        case ESocketQueueResult::QUEUED:
+            requestWrite(connection);
+            break;
+        case ESocketQueueResult::DROPPED:
+            break;
+        case ESocketQueueResult::DISCONNECT:
+            // the client doesn't keep up, close the connection on the thread handling it
+            asio::post(*connection->mIOService, [this, connection]()
+            {
+                if(!connection->mClosed.load())
+                    handleError(*connection, asio::error::no_buffer_space);
+            });
+            break;
+        }
+        return result;
+    }
+
+
+    void SocketServer::addConnection(const std::shared_ptr<Connection>& connection)
+    {
+        // reuse a released slot when available
+        uint32 index;
+        if(!mFreeConnectionSlots.empty())
+        {
+            index = mFreeConnectionSlots.back();
+            mFreeConnectionSlots.pop_back();
+        }else
+        {
+            index = static_cast<uint32>(mConnectionSlots.size());
+            mConnectionSlots.emplace_back();
+        }
+
+        auto& slot = mConnectionSlots[index];
+        slot.mConnection = connection;
+        connection->mHandle = (static_cast<SocketConnectionHandle>(slot.mGeneration) << 32) | index;
+        if(!connection->mID.empty())
+            mConnectionLabels.emplace(connection->mID, connection->mHandle);
+
+        mConnectionCount++;
+    }
+
+
+    void SocketServer::removeConnection(const Connection& connection)
+    {
+        // slot might already be released when the server is destroyed
+        if(findConnection(connection.mHandle) == nullptr)
+            return;
+
+        auto& slot = mConnectionSlots[static_cast<uint32>(connection.mHandle)];
+        slot.mConnection = nullptr;
+
+        // bump generation so stale handles no longer match, 0 is skipped to keep handle 0 invalid
+        if(++slot.mGeneration == 0)
+            slot.mGeneration = 1;
+
+        mFreeConnectionSlots.emplace_back(static_cast<uint32>(connection.mHandle));
+        if(!connection.mID.empty())
+            mConnectionLabels.erase(connection.mID);
+
+        mConnectionCount--;
+    }
+
+
+    const SocketServer::ConnectionSlot* SocketServer::findConnection(SocketConnectionHandle handle) const
+    {
+        auto index = static_cast<uint32>(handle);
+        auto generation = static_cast<uint32>(handle >> 32);
+        if(index >= mConnectionSlots.size())
+            return nullptr;
+
+        const auto& slot = mConnectionSlots[index];
+        if(slot.mGeneration != generation || slot.mConnection == nullptr)
+            return nullptr;
+
+        return &slot;
+    }
+
+
+    bool SocketServer::handleError(Connection& connection, const asio::error_code& errorCode)
     {
         // has an error occured, close socket and re-attach acceptor callback
         if(errorCode)
         {
+            // connection already closed
+            if(connection.mClosed.exchange(true))
+                return true;
+
             // log any errors or info
             logError(utility::stringFormat("Error occured, %s", errorCode.message().c_str()));
             logInfo("Socket disconnected");
 
             // close the socket
             asio::error_code err;
-            auto itr = mSockets.find(id);
-            assert(itr!=mSockets.end());
-            itr->second->shutdown(asio::socket_base::shutdown_both, err);
+            connection.mSocket->shutdown(asio::socket_base::shutdown_both, err);
             if (err)
             {
                 logError(err.message());
             }
+            connection.mSocket->close(err);
 
-            mSocketsToRemove.emplace_back(itr->first);
-            socketDisconnected.trigger(itr->first);
+            // discard queued messages, notifying their senders. The connection is closed, so clearing it doesn't
+            // signal a writable state change anymore
+            connection.mQueue.setWritabilityCallback(nullptr);
+            closeSharedChannel(connection);
+            connection.mQueue.clear();
+
+            // remove connection
+            {
+                std::lock_guard lock(mConnectionMutex);
+                removeConnection(connection);
+            }
+
+            if(auto* metrics = getEnabledMetrics())
+                metrics->recordDisconnect();
+
+            deliver(SocketEvent(static_cast<int>(EEvent::CLOSED), connection.mHandle, connection.mID.data(), connection.mID.size()));
 
             return true;
         }
@@ -191,79 +579,380 @@ namespace nap
     }
 
 
-    void SocketServer::acceptNewSocket()
+    void SocketServer::acceptNewSocket(Acceptor& acceptor)
     {
-        // create socket
-        mWaitingSocket = std::make_unique<tcp::socket>(getIOService());
-        mAcceptor->async_accept(*mWaitingSocket, [this](const asio::error_code& errorCode)
+        // create socket, sharded acceptors keep the connection on their own worker, a single acceptor distributes
+        // connections over the workers
+        auto& io_service = mAcceptors.size() > 1 ? *acceptor.mIOService : getWorkerIOService();
+        acceptor.mWaitingConnection = std::make_shared<Connection>();
+        acceptor.mWaitingConnection->mSocket = std::make_unique<SocketStreamProtocol::socket>(io_service);
+        acceptor.mWaitingConnection->mIOService = &io_service;
+        acceptor.mWaitingConnection->mQueue.setLimits(getQueueLimits());
+        acceptor.mWaitingConnection->mQueue.setMetrics(getEnabledMetrics());
+
+        // writable state changes are signalled on the thread handling the connection, the queue doesn't own the connection
+        std::weak_ptr<Connection> weak_connection = acceptor.mWaitingConnection;
+        acceptor.mWaitingConnection->mQueue.setWritabilityCallback([this, weak_connection](bool writable)
         {
-            handleAccept(errorCode);
+            auto connection = weak_connection.lock();
+            if(connection == nullptr || connection->mClosed.load())
+                return;
+
+            // the connection might close, or the server be destroyed, before the handler runs. Never signal a change
+            // after connectionClosed and don't touch the server once the connection is closed
+            asio::post(*connection->mIOService, [this, connection, writable]()
+            {
+                if(connection->mClosed.load())
+                    return;
+
+                SocketEvent event(static_cast<int>(EEvent::WRITABILITY_CHANGED), connection->mHandle);
+                event.mValue = writable;
+                deliver(std::move(event));
+            });
+        });
+        acceptor.mAcceptor->async_accept(*acceptor.mWaitingConnection->mSocket, [this, &acceptor](const asio::error_code& errorCode)
+        {
+            // acceptor closed, server is being destroyed
+            if(errorCode == asio::error::operation_aborted)
+                return;
+
+            handleAccept(acceptor, errorCode);
         });
     }
 
-    void SocketServer::process()
+
+    void SocketServer::readNext(const std::shared_ptr<Connection>& connection)
+    {
+        auto read_buffer = connection->mReceiveBuffer.prepare(mReceiveBufferSize);
+        connection->mSocket->async_read_some(read_buffer, [this, connection](const asio::error_code& errorCode, std::size_t bytesTransferred)
+        {
+            // socket closed, server might be destroyed
+            if(errorCode == asio::error::operation_aborted || connection->mClosed.load())
+                return;
+
+            // bail on error
+            if(handleError(*connection, errorCode))
+                return;
+
+            // messages of shared memory clients arrive through the channel
+            connection->mReceiveBuffer.commit(bytesTransferred);
+            if(mTransport == ESocketTransport::SHARED_MEMORY)
+            {
+                if(processSharedChannel(connection))
+                    readNext(connection);
+                return;
+            }
+
+            // dispatch received messages
+            bool valid = dispatchMessages(connection->mReceiveBuffer, connection->mReceiveScanned, [this, &connection](const char* data, size_t size)
+            {
+                dispatchMessage(*connection, data, size);
+            });
+            deliverReceivedBatch(*connection);
+
+            // bail on data that can't be decoded
+            if(!valid && handleError(*connection, asio::error::invalid_argument))
+                return;
+
+            readNext(connection);
+        });
+    }
+
+
+    void SocketServer::dispatchMessage(Connection& connection, const char* data, size_t size)
     {
-        // first remove obsolete sockets
-        for(const auto& socket_to_remove : mSocketsToRemove)
+        recordReceived(size);
+        if(batchMessage(connection.mReceivedBatch, data, size))
+            return;
+
+        if(isDeliveredOnMainThread())
         {
-            mSockets.erase(socket_to_remove);
-            mMessageQueue.erase(socket_to_remove);
+            // the main thread looks up the label, the event only holds a pooled copy of the message
+            deliver(SocketEvent(static_cast<int>(EEvent::MESSAGE), connection.mHandle, data, size));
+            return;
         }
-        mSocketsToRemove.clear();
 
-        for(auto& pair : mSockets)
+        auto lock = lockSignals();
+        triggerMessage(connection.mHandle, connection.mID, data, size, connection.mReceivedMessage);
+    }
+
+
+    void SocketServer::deliverReceivedBatch(Connection& connection)
+    {
+        deliverBatch(connection.mReceivedBatch, static_cast<int>(EEvent::MESSAGE_BATCH), connection.mHandle);
+    }
+
+
+    void SocketServer::triggerEvent(const SocketEvent& event)
+    {
+        std::string label;
+        switch(static_cast<EEvent>(event.mType))
         {
-            const auto& socket_id = pair.first;
-            auto& socket = *pair.second;
-            if(socket.is_open())
+        case EEvent::OPENED:
+            connectionOpened.trigger(event.mHandle);
+            if(!mEnableConnectionLabels)
+                break;
+
+            // messages delivered on the main thread are labelled until the connection is closed
+            label.assign(event.mData, event.mSize);
+            if(isDeliveredOnMainThread())
+                mDeliveredLabels[event.mHandle] = label;
+            socketConnected.trigger(label);
+            break;
+        case EEvent::CLOSED:
+            connectionClosed.trigger(event.mHandle);
+            if(!mEnableConnectionLabels)
+                break;
+
+            label.assign(event.mData, event.mSize);
+            if(isDeliveredOnMainThread())
+                mDeliveredLabels.erase(event.mHandle);
+            socketDisconnected.trigger(label);
+            break;
+        case EEvent::WRITABILITY_CHANGED:
+            connectionWritabilityChanged.trigger(event.mHandle, event.mValue);
+            break;
+        case EEvent::MESSAGE:
+        {
+            // only queued messages are triggered here, the socket threads trigger theirs directly. The label is only
+            // passed to the string signal
+            const std::string* id = &label;
+            if(mEnableConnectionLabels && mCopyReceivedMessages)
             {
-                // error code
-                asio::error_code err;
+                auto found_it = mDeliveredLabels.find(event.mHandle);
+                if(found_it != mDeliveredLabels.end())
+                    id = &found_it->second;
+            }
+            triggerMessage(event.mHandle, *id, event.mData, event.mSize, mDeliveredMessage);
+            break;
+        }
+        case EEvent::MESSAGE_BATCH:
+            connectionMessageBatchReceived.trigger(event.mHandle, getEventBatch(event));
+            break;
+        }
+    }
 
-                // let the socket send queued messages
-                std::string message;
-                auto message_queue_itr = mMessageQueue.find(socket_id);
-                assert(message_queue_itr!=mMessageQueue.end());
-                auto& message_queue = message_queue_itr->second;
-                while(message_queue.try_dequeue(message))
-                {
-                    socket.send(asio::buffer(message), asio::socket_base::message_end_of_record, err);
 
-                    if(err)
-                        break;
-                }
+    void SocketServer::triggerMessage(SocketConnectionHandle handle, const std::string& id, const char* data, size_t size, std::string& message)
+    {
+        connectionMessageViewReceived.trigger(handle, std::string_view(data, size));
+        if(!mCopyReceivedMessages)
+            return;
 
-                // bail on error
-                if (handleError(socket_id, err))
-                    continue;
+        // reuse the capacity of the previous message
+        message.assign(data, size);
+        connectionMessageReceived.trigger(handle, message);
+        if(mEnableConnectionLabels)
+            messageReceived.trigger(id, message);
+    }
 
-                // get available bytes
-                size_t available = socket.available(err);
 
-                // bail on error
-                if (handleError(socket_id, err))
-                    continue;
+    bool SocketServer::processSharedChannel(const std::shared_ptr<Connection>& connection)
+    {
+        auto& channel = connection->mSharedChannel;
+        auto& buffer = connection->mReceiveBuffer;
+
+        // the client passes the name of the channel first
+        if(!channel.isOpen())
+        {
+            std::string name;
+            size_t consumed = 0;
+            if(!SocketSharedChannel::decodeHandshake(buffer.data(), buffer.size(), name, consumed))
+            {
+                handleError(*connection, asio::error::invalid_argument);
+                return false;
+            }
 
-                // receive incoming messages
-                asio::streambuf receivedStreamBuffer;
-                asio::streambuf::mutable_buffers_type bufs = receivedStreamBuffer.prepare(available);
-                socket.receive(bufs, asio::socket_base::message_end_of_record, err);
+            // wait for the rest of the handshake
+            if(consumed == 0)
+                return true;
 
-                // bail on error
-                if (handleError(socket_id, err))
-                    continue;
+            utility::ErrorState error_state;
+            if(!channel.open(name, error_state))
+            {
+                logError(error_state.toString());
+                handleError(*connection, asio::error::invalid_argument);
+                return false;
+            }
+        }
+
+        // everything else received on the socket is a wake up
+        buffer.clear();
+
+        // read until the channel stays empty after asking the client for a wake up
+        bool valid = true;
+        do
+        {
+            valid = channel.read([this, &connection](const char* data, size_t size)
+            {
+                dispatchMessage(*connection, data, size);
+            });
+        }while(valid && !channel.armRead() && !connection->mClosed.load());
+
+        // the batch refers to the ring, deliver it before handing the space back
+        deliverReceivedBatch(*connection);
+        channel.release();
+        if(!valid)
+        {
+            handleError(*connection, asio::error::invalid_argument);
+            return false;
+        }
+
+        if(channel.shouldNotifyWriter() && handleError(*connection, notifyPeer(*connection->mSocket)))
+            return false;
+
+        // the client might have made room for the message waiting to be written
+        writeSharedChannel(connection);
+        return !connection->mClosed.load();
+    }
+
+
+    void SocketServer::writeSharedChannel(const std::shared_ptr<Connection>& connection)
+    {
+        // messages are queued until the client opened the channel
+        auto& channel = connection->mSharedChannel;
+        if(!channel.isOpen() || connection->mClosed.load())
+            return;
 
-                // dispatch any received messages
-                for(auto& buf : bufs)
+        // mWriting is set while the message waits for room in the channel
+        bool written = false;
+        auto& message = connection->mWriteMessage;
+        while(true)
+        {
+            if(!connection->mWriting)
+            {
+                if(!connection->mQueue.pop(message))
+                    break;
+
+                if(message.mPayload.size() > channel.getMaxMessageSize())
                 {
-                    if(buf.size()>0)
-                    {
-                        std::string received_message(static_cast<char*>(buf.data()), buf.size());
-                        messageReceived.trigger(socket_id, received_message);
-                    }
+                    logError(utility::stringFormat("Message of %zu bytes exceeds the shared memory size, message dropped", message.mPayload.size()));
+                    message.complete(asio::error::message_size);
+                    continue;
                 }
+                connection->mWriting = true;
+            }
+
+            // wait for the client to make room, unless it did so in the meantime
+            if(!channel.write(message.mPayload.data(), message.mPayload.size()))
+            {
+                if(channel.armWrite(message.mPayload.size()))
+                    break;
+                continue;
+            }
+
+            written = true;
+            connection->mWriting = false;
+            recordSent(message);
+            message.complete({});
+            message.mPayload = SocketPayload();
+        }
+
+        if(written && channel.shouldNotifyReader())
+            handleError(*connection, notifyPeer(*connection->mSocket));
+    }
+
+
+    void SocketServer::closeSharedChannel(Connection& connection)
+    {
+        // complete the message waiting for room in the channel
+        if(connection.mSharedChannel.isOpen() && connection.mWriting)
+        {
+            connection.mWriting = false;
+            connection.mWriteMessage.complete(asio::error::operation_aborted);
+            connection.mWriteMessage.mPayload = SocketPayload();
+        }
+        connection.mSharedChannel.close();
+    }
+
+
+    void SocketServer::requestWrite(const std::shared_ptr<Connection>& connection)
+    {
+        // coalesce requests, a write request is already pending
+        if(connection->mWriteRequested.exchange(true))
+            return;
+
+        asio::post(*connection->mIOService, [this, connection]()
+        {
+            connection->mWriteRequested.store(false);
+            if(!connection->mWriting && !connection->mClosed.load())
+                writeNext(connection);
+        });
+    }
+
+
+    void SocketServer::writeNext(const std::shared_ptr<Connection>& connection)
+    {
+        if(mTransport == ESocketTransport::SHARED_MEMORY)
+        {
+            writeSharedChannel(connection);
+            return;
+        }
+
+        // let the socket send the next queued message, stop writing when the queue is drained
+        connection->mWriting = false;
+        auto& message = connection->mWriteMessage;
+        while(connection->mQueue.pop(message))
+        {
+            // frame the message, messages the framing can't encode are dropped
+            if(encodeFrame(message.mPayload.size(), connection->mWriteEncoding))
+            {
+                connection->mWriting = true;
+                break;
             }
+            logError(utility::stringFormat("Cannot frame message of %zu bytes, message dropped", message.mPayload.size()));
+            message.complete(asio::error::message_size);
         }
+
+        if(!connection->mWriting)
+            return;
+
+        // write straight from the payload, which is kept alive until the write completes
+        const auto& encoding = connection->mWriteEncoding;
+        std::array<asio::const_buffer, 3> buffers =
+        {
+            asio::buffer(encoding.mHeader.data(), encoding.mHeaderSize),
+            message.mPayload.buffer(),
+            encoding.mTrailer
+        };
+        asio::async_write(*connection->mSocket, buffers, [this, connection](const asio::error_code& errorCode, std::size_t bytesTransferred)
+        {
+            // notify the sender and release the shared data
+            auto& message = connection->mWriteMessage;
+            if(!errorCode && !connection->mClosed.load())
+                recordSent(message);
+            message.complete(connection->mClosed.load() ? asio::error::operation_aborted : errorCode);
+            message.mPayload = SocketPayload();
+
+            // socket closed, server might be destroyed
+            if(errorCode == asio::error::operation_aborted || connection->mClosed.load())
+                return;
+
+            // bail on error
+            if(handleError(*connection, errorCode))
+                return;
+
+            writeNext(connection);
+        });
+    }
+
+
+    void SocketServer::executeOnIOService(asio::io_service& service, std::function<void()> function)
+    {
+        // post to the thread running the io_service, otherwise the io_service is run by the calling thread
+        if(isRunByOwnThread(service))
+        {
+            asio::post(service, std::move(function));
+        }else
+        {
+            function();
+        }
+    }
+
+
+    void SocketServer::process()
+    {
+        // connections are handled asynchronously by the io_service of the thread or its workers
     }
 
 
@@ -287,21 +976,22 @@ namespace nap
 
     void SocketServer::clearQueue()
     {
-        for(auto& pair : mMessageQueue)
+        std::lock_guard lock(mConnectionMutex);
+        for(auto& slot : mConnectionSlots)
         {
-            while(pair.second.size_approx()>0)
-            {
-                std::string message;
-                pair.second.try_dequeue(message);
-            }
+            if(slot.mConnection == nullptr)
+                continue;
+
+            slot.mConnection->mQueue.clear();
         }
     }
 
 
     std::vector<std::string> SocketServer::getConnectedClientIDs() const
     {
+        std::lock_guard lock(mConnectionMutex);
         std::vector<std::string> clients;
-        for(const auto& pair : mSockets)
+        for(const auto& pair : mConnectionLabels)
         {
             clients.emplace_back(pair.first);
         }
@@ -309,8 +999,79 @@ namespace nap
     }
 
 
+    std::vector<SocketConnectionHandle> SocketServer::getConnectionHandles() const
+    {
+        std::lock_guard lock(mConnectionMutex);
+        std::vector<SocketConnectionHandle> handles;
+        handles.reserve(mConnectionCount);
+        for(const auto& slot : mConnectionSlots)
+        {
+            if(slot.mConnection != nullptr)
+                handles.emplace_back(slot.mConnection->mHandle);
+        }
+        return handles;
+    }
+
+
+    std::string SocketServer::getConnectionLabel(SocketConnectionHandle handle) const
+    {
+        std::lock_guard lock(mConnectionMutex);
+        const auto* slot = findConnection(handle);
+        return slot != nullptr ? slot->mConnection->mID : std::string();
+    }
+
+
+    bool SocketServer::isConnected(SocketConnectionHandle handle) const
+    {
+        std::lock_guard lock(mConnectionMutex);
+        return findConnection(handle) != nullptr;
+    }
+
+
+    SocketQueueDepth SocketServer::getQueueDepth(SocketConnectionHandle handle) const
+    {
+        std::lock_guard lock(mConnectionMutex);
+        const auto* slot = findConnection(handle);
+        return slot != nullptr ? slot->mConnection->mQueue.getDepth() : SocketQueueDepth();
+    }
+
+
+    uint64 SocketServer::getDroppedCount(SocketConnectionHandle handle) const
+    {
+        std::lock_guard lock(mConnectionMutex);
+        const auto* slot = findConnection(handle);
+        return slot != nullptr ? slot->mConnection->mQueue.getDroppedCount() : 0;
+    }
+
+
+    SocketQueueDepth SocketServer::getTotalQueueDepth() const
+    {
+        std::lock_guard lock(mConnectionMutex);
+        SocketQueueDepth total;
+        for(const auto& slot : mConnectionSlots)
+        {
+            if(slot.mConnection == nullptr)
+                continue;
+
+            auto depth = slot.mConnection->mQueue.getDepth();
+            total.mMessages += depth.mMessages;
+            total.mBytes += depth.mBytes;
+        }
+        return total;
+    }
+
+
+    bool SocketServer::isWritable(SocketConnectionHandle handle) const
+    {
+        std::lock_guard lock(mConnectionMutex);
+        const auto* slot = findConnection(handle);
+        return slot != nullptr && slot->mConnection->mQueue.isWritable();
+    }
+
+
     size_t SocketServer::getConnectedClientsCount() const
     {
-        return mSockets.size();
+        std::lock_guard lock(mConnectionMutex);
+        return mConnectionCount;
     }
 }
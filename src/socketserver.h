@@ -8,6 +8,7 @@
 #include <nap/device.h>
 #include <thread>
 #include <mutex>
+#include <string_view>
 
 // NAP includes
 #include <nap/numeric.h>
@@ -23,15 +24,36 @@
 
 // Local includes
 #include "socketadapter.h"
+#include "socketpayload.h"
+#include "socketsharedmemory.h"
 
 namespace nap
 {
     //////////////////////////////////////////////////////////////////////////
 
+    /**
+     * Compact handle identifying a connection of a SocketServer. The lower 32 bits index a connection slot, the upper
+     * 32 bits hold the generation of that slot, so the handle of a closed connection never refers to a newer connection
+     * reusing the same slot. A handle of 0 is invalid.
+     */
+    using SocketConnectionHandle = uint64;
+
     /**
      * SocketServer creates a new socket and waits for any incoming connections.
-     * You can connect as many clients as you want to the server.
-     * Every new connection / socket will get a unique ID.
+     * You can connect as many clients as you want to the server. The server listens on a TCP port or, when 'Transport'
+     * is set to Local, on a local stream socket for clients on the same host. Both use the same signals and send API.
+     * With the Shared Memory transport clients connect to the local stream socket and pass a SocketSharedChannel,
+     * messages are exchanged through shared memory and the socket only carries wake ups. Messages are delimited by the
+     * channel, the 'Framing' property is ignored.
+     * Every new connection / socket will get a compact SocketConnectionHandle and, when 'Connection Labels' is enabled,
+     * a unique string ID. Prefer the handle based send() overloads and connection signals, they avoid string hashing.
+     * Setting 'Acceptor Count' higher than 1 opens multiple acceptors on the same port using SO_REUSEPORT, letting the
+     * kernel balance incoming connections over acceptors that each run on their own SocketThread worker.
+     * When the SocketThread has workers, new connections are distributed over the worker threads. Incoming messages and
+     * disconnects of those connections are dispatched on the worker thread handling the connection. Signals of different
+     * workers are serialized by a lock, so a slot never runs on two workers at once but a slow slot stalls all of them.
+     * Set 'Signal Delivery' to Main Thread to have all signals queued instead and dispatched by SocketService::update().
+     * Every connection has its own outgoing queue, bounded by the 'Queue' properties of the SocketAdapter.
      */
     class NAPAPI SocketServer final : public SocketAdapter
     {
@@ -50,11 +72,19 @@ namespace nap
         virtual void onDestroy() override;
 
         /**
-         * Send message to all connected sockets
+         * Send message to all connected sockets.
+         * The message is copied once and shared by all connections
          * @param message the message
          */
         void sendToAll(const std::string& message);
 
+        /**
+         * Send payload to all connected sockets.
+         * Only a handle to the payload is queued per connection, the data is written straight from the shared payload
+         * @param payload the payload
+         */
+        void sendToAll(const SocketPayload& payload);
+
         /**
          * Send message to specific socket
          * @param id client id
@@ -63,11 +93,94 @@ namespace nap
         void send(const std::string& id, const std::string& message);
 
         /**
-         * Returns vector with all id's of connected clients
+         * Send payload to specific socket
+         * @param id client id
+         * @param payload the payload
+         */
+        void send(const std::string& id, const SocketPayload& payload);
+
+        /**
+         * Send message to specific connection
+         * @param handle connection handle
+         * @param message the message
+         */
+        void send(SocketConnectionHandle handle, const std::string& message);
+
+        /**
+         * Send payload to specific connection
+         * @param handle connection handle
+         * @param payload the payload
+         */
+        void send(SocketConnectionHandle handle, const SocketPayload& payload);
+
+        /**
+         * Send message to specific connection and get notified when it is handed to the kernel.
+         * The callback is invoked exactly once: on the thread handling the connection when the message is written or
+         * discarded, or on the calling thread when the message is not queued, see SocketSendCallback
+         * @param handle connection handle
+         * @param message the message
+         * @param callback called with the result of sending the message, can be nullptr
+         * @return whether the message is queued
+         */
+        ESocketQueueResult send(SocketConnectionHandle handle, const std::string& message, SocketSendCallback callback);
+
+        /**
+         * Send payload to specific connection and get notified when it is handed to the kernel, see above
+         * @param handle connection handle
+         * @param payload the payload
+         * @param callback called with the result of sending the payload, can be nullptr
+         * @return whether the payload is queued
+         */
+        ESocketQueueResult send(SocketConnectionHandle handle, const SocketPayload& payload, SocketSendCallback callback);
+
+        /**
+         * Returns vector with all id's of connected clients, empty when 'Connection Labels' is disabled
          * @return vector containing client ids
          */
         std::vector<std::string> getConnectedClientIDs() const;
 
+        /**
+         * Returns vector with the handles of all connected clients
+         * @return vector containing connection handles
+         */
+        std::vector<SocketConnectionHandle> getConnectionHandles() const;
+
+        /**
+         * Returns the string ID of a connection, empty when the connection is closed or 'Connection Labels' is disabled
+         * @param handle connection handle
+         * @return the string ID of the connection
+         */
+        std::string getConnectionLabel(SocketConnectionHandle handle) const;
+
+        /**
+         * Returns whether the handle refers to a connected client
+         * @param handle connection handle
+         * @return whether the connection is open
+         */
+        bool isConnected(SocketConnectionHandle handle) const;
+
+        /**
+         * Returns the number of messages and bytes waiting to be sent to a connection
+         * @param handle connection handle
+         * @return the outgoing queue depth, empty when the connection is closed
+         */
+        SocketQueueDepth getQueueDepth(SocketConnectionHandle handle) const;
+
+        /**
+         * Returns the number of messages dropped because the outgoing queue of a connection was full
+         * @param handle connection handle
+         * @return the number of dropped messages, 0 when the connection is closed
+         */
+        uint64 getDroppedCount(SocketConnectionHandle handle) const;
+
+        /**
+         * Returns false when more bytes are queued for the connection than the 'Queue High Watermark', until its queue
+         * drains to the 'Queue Low Watermark'. Always true for open connections when the watermarks are disabled
+         * @param handle connection handle
+         * @return whether the connection accepts more messages without growing its backlog, false when closed
+         */
+        bool isWritable(SocketConnectionHandle handle) const;
+
         /**
          * Returns amount of connected clients
          * @return amount of connected clients
@@ -77,45 +190,221 @@ namespace nap
         // properties
         int mPort 						= 13251;		///< Property: 'Port' the port the server socket binds to
         std::string mIPAddress			= "";	        ///< Property: 'IP Address' local ip address to bind to, if left empty will bind to any local address
+        ESocketTransport mTransport     = ESocketTransport::TCP; ///< Property: 'Transport' accept TCP connections or connections on a local stream socket from the same host
+        std::string mLocalPath          = "";           ///< Property: 'Local Path' path of the local socket to listen on, a path starting with '@' refers to the Linux abstract namespace
         bool mEnableLog                 = false;        ///< Property: 'Enable Log' whether the server should log to the console
+        int mReceiveBufferSize          = 8192;         ///< Property: 'Receive Buffer Size' number of bytes each connection reads at once
+        bool mEnableConnectionLabels    = true;         ///< Property: 'Connection Labels' whether every connection gets a unique string ID, required by the string based send() and signals
+        int mAcceptorCount              = 1;            ///< Property: 'Acceptor Count' number of acceptors bound to the port using SO_REUSEPORT, each acceptor runs on its own SocketThread worker, requires 'Worker Count' of at least 1
     public:
         // Signals
         /**
-         * Packet received signal will be dispatched on the thread this SocketAdapter is registered to, see SocketThread
+         * Packet received signal will be dispatched on the thread this SocketAdapter is registered to, see SocketThread,
+         * or on the worker thread handling the connection
          * First argument is id, second is received message
          */
         Signal<const std::string&, const std::string&> messageReceived;
 
         /**
-         * Socket connected signal, will be dispatched on the thread this SocketAdapter is registered to, see SocketThread
+         * Socket connected signal, will be dispatched on the thread this SocketAdapter is registered to, see SocketThread,
+         * or on the worker thread handling the acceptor when the server has multiple acceptors
          * Argument is id of socket connected
          */
         Signal<const std::string&> socketConnected;
 
         /**
-         * Socket disconnected signal, will be dispatched on the thread this SocketAdapter is registered to, see SocketThread
+         * Socket disconnected signal, will be dispatched on the thread this SocketAdapter is registered to, see SocketThread,
+         * or on the worker thread handling the connection
          * Argument is id of socket disconnected
          */
         Signal<const std::string&> socketDisconnected;
+
+        /**
+         * Packet received signal, dispatched on the same thread as messageReceived
+         * First argument is the connection handle, second is received message
+         */
+        Signal<SocketConnectionHandle, const std::string&> connectionMessageReceived;
+
+        /**
+         * Packet received signal passing a read-only view into the receive buffer of the connection, dispatched on the
+         * same thread as messageReceived. The view is only valid for the duration of the call, copy the data to keep it.
+         * Fires regardless of 'Copy Received Messages'
+         * First argument is the connection handle, second is received message
+         */
+        Signal<SocketConnectionHandle, std::string_view> connectionMessageViewReceived;
+
+        /**
+         * Packets received signal passing read-only views of all messages a connection received in one pass, dispatched
+         * on the same thread as messageReceived. Requires 'Batch Received Messages', which replaces the per-message receive
+         * signals of the connection. The views are only valid for the duration of the call
+         * First argument is the connection handle, second are the received messages in order of arrival
+         */
+        Signal<SocketConnectionHandle, const std::vector<std::string_view>&> connectionMessageBatchReceived;
+
+        /**
+         * Connection opened signal, dispatched on the same thread as socketConnected
+         * Argument is the handle of the connection
+         */
+        Signal<SocketConnectionHandle> connectionOpened;
+
+        /**
+         * Connection closed signal, dispatched on the same thread as socketDisconnected
+         * Argument is the handle of the connection
+         */
+        Signal<SocketConnectionHandle> connectionClosed;
+
+        /**
+         * Writable state changed signal, dispatched on the thread handling the connection
+         * First argument is the handle of the connection, second is the new writable state, see isWritable()
+         */
+        Signal<SocketConnectionHandle, bool> connectionWritabilityChanged;
     protected:
         /**
          * The process function
          */
         void process() override;
+
+        /**
+         * @return number of messages and bytes waiting to be sent, summed over all connections
+         */
+        SocketQueueDepth getTotalQueueDepth() const override;
+
+        /**
+         * Triggers the signals of a connection event, see EEvent
+         * @param event the event
+         */
+        void triggerEvent(const SocketEvent& event) override;
     private:
+        /**
+         * Events delivered by the server, opened and closed events carry the label of the connection
+         */
+        enum class EEvent : int
+        {
+            OPENED                  = 0,
+            CLOSED                  = 1,
+            WRITABILITY_CHANGED     = 2,
+            MESSAGE                 = 3,
+            MESSAGE_BATCH           = 4
+        };
+
+        /**
+         * Holds the socket and outgoing message queue of a single connection.
+         * A connection is handled by the asio::io_service its socket is created on, this is either the io_service of
+         * the SocketThread or one of its workers.
+         */
+        struct Connection
+        {
+            SocketConnectionHandle                      mHandle = 0;
+            std::string                                 mID;                    ///< string label, empty when 'Connection Labels' is disabled
+            std::unique_ptr<SocketStreamProtocol::socket> mSocket;
+            asio::io_service*                           mIOService = nullptr;   ///< io_service handling the connection
+            SocketSendQueue                             mQueue;
+            SocketReceiveBuffer                         mReceiveBuffer;         ///< received data that is not dispatched yet
+            size_t                                      mReceiveScanned = 0;    ///< scan state of the framing codec
+            std::string                                 mReceivedMessage;       ///< copy of the last received message, reused to avoid allocations
+            std::vector<std::string_view>               mReceivedBatch;         ///< messages received in the current pass
+            SocketQueuedMessage                         mWriteMessage;          ///< message of the pending write
+            SocketFrameEncoding                         mWriteEncoding;         ///< frame header and trailer of the pending write
+            bool                                        mWriting = false;       ///< whether a write is pending, or a message waits for room in the shared memory channel
+            SocketSharedChannel                         mSharedChannel;         ///< shared memory channel of a Shared Memory client
+            std::atomic_bool                            mWriteRequested = { false };
+            std::atomic_bool                            mClosed = { false };
+        };
+
+        /**
+         * Accepts connections on the port, a server has multiple acceptors when sharded using SO_REUSEPORT
+         */
+        struct Acceptor
+        {
+            std::unique_ptr<SocketStreamAcceptor> mAcceptor;
+            std::shared_ptr<Connection>                 mWaitingConnection;
+            asio::io_service*                           mIOService = nullptr; ///< io_service handling the acceptor
+        };
+
         /**
          * Called when a new socket is connected
+         * @param acceptor the acceptor that accepted the socket
          * @param errorCode holds any error generated during connect
          */
-        void handleAccept(const asio::error_code& errorCode);
+        void handleAccept(Acceptor& acceptor, const asio::error_code& errorCode);
 
         /**
-         * Called when an error occurs in process(), closes socket with given id
-         * @param id the id of the socket that generates the error
+         * Called when an error occurs on a connection, closes the socket of the connection
+         * @param connection the connection that generates the error
          * @param errorCode the errorcode
          * @return whether an error is handled, if errorCode is empty, will return false
          */
-        bool handleError(const std::string& id, asio::error_code& errorCode);
+        bool handleError(Connection& connection, const asio::error_code& errorCode);
+
+        /**
+         * Starts an asynchronous read on the connection, dispatches the received data and reads again on completion
+         * @param connection the connection to read from
+         */
+        void readNext(const std::shared_ptr<Connection>& connection);
+
+        /**
+         * Dispatches a received message of the connection
+         * @param connection the connection that received the message
+         * @param data pointer to the message
+         * @param size size of the message in bytes
+         */
+        void dispatchMessage(Connection& connection, const char* data, size_t size);
+
+        /**
+         * Triggers the receive signals of a message
+         * @param handle handle of the connection that received the message
+         * @param id label of the connection
+         * @param data pointer to the message
+         * @param size size of the message in bytes
+         * @param message string the message is copied into when received messages are copied
+         */
+        void triggerMessage(SocketConnectionHandle handle, const std::string& id, const char* data, size_t size, std::string& message);
+
+        /**
+         * Triggers the batch receive signal with the messages the connection received in the current pass
+         * @param connection the connection that received the messages
+         */
+        void deliverReceivedBatch(Connection& connection);
+
+        /**
+         * Opens the shared memory channel once the handshake is received, reads all messages in the channel and writes
+         * the message waiting for room. Called every time the client sends a wake up
+         * @param connection the connection of a Shared Memory client
+         * @return false when the connection is closed
+         */
+        bool processSharedChannel(const std::shared_ptr<Connection>& connection);
+
+        /**
+         * Writes queued messages to the shared memory channel until the queue is drained or the channel is full
+         * @param connection the connection of a Shared Memory client
+         */
+        void writeSharedChannel(const std::shared_ptr<Connection>& connection);
+
+        /**
+         * Closes the shared memory channel of the connection, the message waiting for room is discarded
+         * @param connection the connection
+         */
+        void closeSharedChannel(Connection& connection);
+
+        /**
+         * Requests queued messages of the connection to be written, on the thread handling the connection. Thread-safe
+         * @param connection the connection to write to
+         */
+        void requestWrite(const std::shared_ptr<Connection>& connection);
+
+        /**
+         * Starts an asynchronous write of the next queued message, writes the next one on completion until the queue is drained
+         * @param connection the connection to write to
+         */
+        void writeNext(const std::shared_ptr<Connection>& connection);
+
+        /**
+         * Executes the function on the thread running the io_service. Executes the function immediately when the
+         * io_service is not run by a thread owned by the SocketThread
+         * @param service the io_service
+         * @param function the function to execute
+         */
+        void executeOnIOService(asio::io_service& service, std::function<void()> function);
 
         /**
          * Clears current message queue
@@ -135,18 +424,64 @@ namespace nap
         void logInfo(const std::string& message);
 
         /**
-         * Creates a new socket and tells the acceptor to wait for new connections
+         * Creates a new connection and tells the acceptor to wait for new connections
+         * @param acceptor the acceptor to wait on
          */
-        void acceptNewSocket();
+        void acceptNewSocket(Acceptor& acceptor);
 
         // ASIO
-        std::unique_ptr<asio::ip::tcp::socket>                                  mWaitingSocket;
-        std::unordered_map<std::string, std::unique_ptr<asio::ip::tcp::socket>> mSockets;
-        std::unique_ptr<asio::ip::tcp::endpoint> 	                            mRemoteEndpoint;
-        std::unique_ptr<asio::ip::tcp::acceptor>                                mAcceptor;
-
-        // Threading
-        std::unordered_map<std::string, moodycamel::ConcurrentQueue<std::string>> 	mMessageQueue;
-        std::vector<std::string>                    mSocketsToRemove;
+        std::unique_ptr<SocketStreamProtocol::endpoint>                         mRemoteEndpoint;
+        std::vector<std::unique_ptr<Acceptor>>                                  mAcceptors;
+
+        // identifies the socket file bound to 'Local Path', 0 when the server didn't create one
+        uint64                                                                  mLocalPathDevice = 0;
+        uint64                                                                  mLocalPathInode = 0;
+
+        /**
+         * Slot holding a connection, the generation is incremented every time the slot is released
+         */
+        struct ConnectionSlot
+        {
+            std::shared_ptr<Connection>     mConnection;
+            uint32                          mGeneration = 1;
+        };
+
+        /**
+         * Stores the connection in a free slot and assigns its handle. Connection mutex must be locked
+         * @param connection the connection to add
+         */
+        void addConnection(const std::shared_ptr<Connection>& connection);
+
+        /**
+         * Releases the slot of the connection. Connection mutex must be locked
+         * @param connection the connection to remove
+         */
+        void removeConnection(const Connection& connection);
+
+        /**
+         * Returns the slot of the connection referred to by the handle. Connection mutex must be locked
+         * @param handle connection handle
+         * @return the slot, nullptr when the handle does not refer to an open connection
+         */
+        const ConnectionSlot* findConnection(SocketConnectionHandle handle) const;
+
+        /**
+         * Queues the message and requests it to be written. Thread-safe
+         * @param connection the connection to send to
+         * @param message the message
+         * @return whether the message is queued
+         */
+        ESocketQueueResult enqueue(const std::shared_ptr<Connection>& connection, SocketQueuedMessage message);
+
+        // Connections
+        std::vector<ConnectionSlot>                                     mConnectionSlots;
+        std::vector<uint32>                                             mFreeConnectionSlots;
+        std::unordered_map<std::string, SocketConnectionHandle>         mConnectionLabels;
+        size_t                                                          mConnectionCount = 0;
+        mutable std::mutex                                              mConnectionMutex;
+
+        // copy of the last message delivered on the main thread, and the labels of the connections opened on the main thread
+        std::string                                                     mDeliveredMessage;
+        std::unordered_map<SocketConnectionHandle, std::string>         mDeliveredLabels;
     };
 }
@@ -5,6 +5,8 @@
 // Local Includes
 #include "socketservice.h"
 #include "socketthread.h"
+#include "socketadapter.h"
+#include "socketbufferpool.h"
 
 // External includes
 #include <memory>
@@ -33,6 +35,8 @@ namespace nap
 
 	void SocketService::shutdown()
 	{
+		// free the buffers cached by the pool, all sockets are closed by now
+		SocketBufferPool::get().trim();
 	}
 
 
@@ -48,6 +52,11 @@ namespace nap
 		{
 			thread->process();
 		}
+
+		for(auto* adapter : mDeliveryAdapters)
+		{
+			adapter->dispatchEvents();
+		}
 	}
 
 
@@ -66,4 +75,18 @@ namespace nap
 	{
 		mThreads.emplace_back(thread);
 	}
+
+
+	void SocketService::registerDeliveryAdapter(SocketAdapter* adapter)
+	{
+		mDeliveryAdapters.emplace_back(adapter);
+	}
+
+
+	void SocketService::removeDeliveryAdapter(SocketAdapter* adapter)
+	{
+		auto found_it = std::find(mDeliveryAdapters.begin(), mDeliveryAdapters.end(), adapter);
+		assert(found_it != mDeliveryAdapters.end());
+		mDeliveryAdapters.erase(found_it);
+	}
 }
@@ -12,6 +12,7 @@ namespace nap
 	//////////////////////////////////////////////////////////////////////////
 	// forward declares
 	class SocketThread;
+	class SocketAdapter;
 
 	/**
 	 * The SocketServer is responsible for processing any SocketThread that has registered itself to receive an
@@ -20,6 +21,7 @@ namespace nap
 	class NAPAPI SocketService : public Service
 	{
 		friend class SocketThread;
+		friend class SocketAdapter;
 
 		RTTI_ENABLE(Service)
 	public:
@@ -48,7 +50,8 @@ namespace nap
 		virtual void shutdown() override;
 
 		/**
-		 * Update call wil call process on any registered SocketThread
+		 * Update call wil call process on any registered SocketThread, afterwards the signals of adapters that deliver
+		 * them on the main thread are triggered
 		 * @param deltaTime time since last update
 		 */
 		virtual void update(double deltaTime) override;
@@ -65,8 +68,23 @@ namespace nap
 		 * @param thread the thread do remove
 		 */
 		void removeSocketThread(SocketThread* thread);
+
+		/**
+		 * Registers an adapter whose signals are delivered on the main thread, see SocketAdapter 'Signal Delivery'
+		 * @param adapter the adapter to register
+		 */
+		void registerDeliveryAdapter(SocketAdapter* adapter);
+
+		/**
+		 * Removes an adapter whose signals are delivered on the main thread
+		 * @param adapter the adapter to remove
+		 */
+		void removeDeliveryAdapter(SocketAdapter* adapter);
 	private:
 		// registered udp threads
 		std::vector<SocketThread*> mThreads;
+
+		// adapters delivering their signals on the main thread
+		std::vector<SocketAdapter*> mDeliveryAdapters;
 	};
 }
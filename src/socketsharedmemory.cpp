@@ -0,0 +1,436 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#include "socketsharedmemory.h"
+
+// External includes
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <new>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define NAPSOCKET_HAS_SHARED_MEMORY
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace nap
+{
+    // identifies a segment created by SocketSharedChannel
+    static constexpr uint32 sSegmentMagic = 0x4e53484d;
+    static constexpr uint32 sSegmentVersion = 1;
+
+    // every segment name starts with this prefix, open() refuses other names
+    static constexpr const char* sSegmentNamePrefix = "/napsocket-";
+
+    // every message is preceded by its size, records are aligned to the size of the header
+    static constexpr size_t sRecordHeaderSize = 8;
+
+    // record size marking the rest of the ring as unused, the next record starts at the beginning of the ring
+    static constexpr uint32 sWrapMarker = 0xffffffff;
+
+    // the handshake is the length of the name followed by the name
+    static constexpr size_t sHandshakeHeaderSize = 1;
+
+    static constexpr size_t sCacheLineSize = 64;
+
+    /**
+     * Placed at the start of the segment
+     */
+    struct SegmentHeader
+    {
+        uint32  mMagic = 0;
+        uint32  mVersion = 0;
+        uint64  mRingCapacity = 0;
+    };
+
+
+    /**
+     * Shared state of a ring, the positions only increase and are kept on separate cache lines
+     */
+    struct SocketSharedRingHeader
+    {
+        alignas(sCacheLineSize) std::atomic<uint64> mHead = { 0 };          ///< read position, written by the consumer
+        alignas(sCacheLineSize) std::atomic<uint64> mTail = { 0 };          ///< write position, written by the producer
+        alignas(sCacheLineSize) std::atomic<uint32> mReaderWaiting = { 0 }; ///< set by a consumer going to sleep
+        std::atomic<uint32>                         mWriterWaiting = { 0 }; ///< set by a producer waiting for room
+    };
+
+    static_assert(std::atomic<uint64>::is_always_lock_free && std::atomic<uint32>::is_always_lock_free, "shared memory rings require lock-free atomics");
+
+    static constexpr size_t sSegmentHeaderSize = sCacheLineSize;
+    static constexpr size_t sRingHeaderSize = (sizeof(SocketSharedRingHeader) + sCacheLineSize - 1) & ~(sCacheLineSize - 1);
+
+
+    static size_t getSegmentSize(size_t ringCapacity)
+    {
+        return sSegmentHeaderSize + 2 * (sRingHeaderSize + ringCapacity);
+    }
+
+    //////////////////////////////////////////////////////////////////////////
+    // SocketSharedChannel
+    //////////////////////////////////////////////////////////////////////////
+
+    SocketSharedChannel::~SocketSharedChannel()
+    {
+        close();
+    }
+
+
+    bool SocketSharedChannel::create(size_t ringCapacity, utility::ErrorState& errorState)
+    {
+        close();
+
+#ifdef NAPSOCKET_HAS_SHARED_MEMORY
+        size_t capacity = sMinRingCapacity;
+        while(capacity < ringCapacity)
+            capacity <<= 1;
+
+        // unique per process, short enough for systems limiting the name to 31 characters
+        static std::atomic<uint32> segment_counter = { 0 };
+        std::string name = sSegmentNamePrefix + std::to_string(::getpid()) + "-" + std::to_string(segment_counter.fetch_add(1));
+
+        int fd = ::shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, S_IRUSR | S_IWUSR);
+        if(!errorState.check(fd >= 0, "Cannot create shared memory segment %s: %s", name.c_str(), std::strerror(errno)))
+            return false;
+
+        size_t segment_size = getSegmentSize(capacity);
+        void* segment = MAP_FAILED;
+        if(::ftruncate(fd, static_cast<off_t>(segment_size)) == 0)
+            segment = ::mmap(nullptr, segment_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        int error = errno;
+        ::close(fd);
+
+        if(segment == MAP_FAILED)
+        {
+            ::shm_unlink(name.c_str());
+            errorState.fail("Cannot map shared memory segment %s: %s", name.c_str(), std::strerror(error));
+            return false;
+        }
+
+        mName = std::move(name);
+        mSegment = static_cast<char*>(segment);
+        mSegmentSize = segment_size;
+        mRingCapacity = capacity;
+        mUnlinkOnClose = true;
+
+        auto* header = new (mSegment) SegmentHeader();
+        header->mMagic = sSegmentMagic;
+        header->mVersion = sSegmentVersion;
+        header->mRingCapacity = capacity;
+        new (mSegment + sSegmentHeaderSize) SocketSharedRingHeader();
+        new (mSegment + sSegmentHeaderSize + sRingHeaderSize + capacity) SocketSharedRingHeader();
+
+        attach(true);
+        return true;
+#else
+        errorState.fail("Shared memory channels are not supported on this platform");
+        return false;
+#endif
+    }
+
+
+    bool SocketSharedChannel::open(const std::string& name, utility::ErrorState& errorState)
+    {
+        close();
+
+#ifdef NAPSOCKET_HAS_SHARED_MEMORY
+        // the name is sent by the peer, never open or remove a segment that wasn't created by a channel
+        std::string prefix = sSegmentNamePrefix;
+        bool valid_name = name.size() > prefix.size() && name.compare(0, prefix.size(), prefix) == 0 &&
+            name.find('/', prefix.size()) == std::string::npos;
+        if(!errorState.check(valid_name, "Shared memory segment name %s is not a channel", name.c_str()))
+            return false;
+
+        int fd = ::shm_open(name.c_str(), O_RDWR, 0);
+        if(!errorState.check(fd >= 0, "Cannot open shared memory segment %s: %s", name.c_str(), std::strerror(errno)))
+            return false;
+
+        struct stat status;
+        void* segment = MAP_FAILED;
+        size_t segment_size = 0;
+        if(::fstat(fd, &status) == 0 && static_cast<size_t>(status.st_size) > sSegmentHeaderSize)
+        {
+            segment_size = static_cast<size_t>(status.st_size);
+            segment = ::mmap(nullptr, segment_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        }
+        int error = errno;
+        ::close(fd);
+
+        if(!errorState.check(segment != MAP_FAILED, "Cannot map shared memory segment %s: %s", name.c_str(), std::strerror(error)))
+            return false;
+
+        mName = name;
+        mSegment = static_cast<char*>(segment);
+        mSegmentSize = segment_size;
+
+        // validate the layout before trusting any offsets
+        const auto* header = reinterpret_cast<const SegmentHeader*>(mSegment);
+        uint64 capacity = header->mRingCapacity;
+        bool valid = header->mMagic == sSegmentMagic && header->mVersion == sSegmentVersion &&
+            capacity >= sMinRingCapacity && (capacity & (capacity - 1)) == 0 && getSegmentSize(capacity) == segment_size;
+        if(!errorState.check(valid, "Shared memory segment %s is not a valid channel", name.c_str()))
+        {
+            close();
+            return false;
+        }
+
+        // the name is not needed anymore, the segment is released once both processes unmapped it
+        ::shm_unlink(name.c_str());
+
+        mRingCapacity = static_cast<size_t>(capacity);
+        attach(false);
+        return true;
+#else
+        errorState.fail("Shared memory channels are not supported on this platform");
+        return false;
+#endif
+    }
+
+
+    void SocketSharedChannel::close()
+    {
+#ifdef NAPSOCKET_HAS_SHARED_MEMORY
+        if(mSegment != nullptr)
+            ::munmap(mSegment, mSegmentSize);
+
+        // fails harmlessly when the peer already removed the name
+        if(mUnlinkOnClose)
+            ::shm_unlink(mName.c_str());
+#endif
+        mName.clear();
+        mSegment = nullptr;
+        mSegmentSize = 0;
+        mRingCapacity = 0;
+        mUnlinkOnClose = false;
+        mSend = Ring();
+        mReceive = Ring();
+    }
+
+
+    void SocketSharedChannel::attach(bool creator)
+    {
+        Ring first;
+        first.mHeader = reinterpret_cast<SocketSharedRingHeader*>(mSegment + sSegmentHeaderSize);
+        first.mData = mSegment + sSegmentHeaderSize + sRingHeaderSize;
+
+        Ring second;
+        second.mHeader = reinterpret_cast<SocketSharedRingHeader*>(first.mData + mRingCapacity);
+        second.mData = first.mData + mRingCapacity + sRingHeaderSize;
+
+        mSend = creator ? first : second;
+        mReceive = creator ? second : first;
+
+        // continue where the rings are, the peer might have written already
+        mSend.mPosition = mSend.mHeader->mTail.load(std::memory_order_acquire);
+        mSend.mCachedPosition = mSend.mHeader->mHead.load(std::memory_order_acquire);
+        mReceive.mPosition = mReceive.mHeader->mHead.load(std::memory_order_acquire);
+        mReceive.mCachedPosition = mReceive.mHeader->mTail.load(std::memory_order_acquire);
+    }
+
+
+    size_t SocketSharedChannel::getMaxMessageSize() const
+    {
+        return mRingCapacity > sRecordHeaderSize ? mRingCapacity - sRecordHeaderSize : 0;
+    }
+
+
+    size_t SocketSharedChannel::getRecordSize(size_t size) const
+    {
+        return (sRecordHeaderSize + size + sRecordHeaderSize - 1) & ~(sRecordHeaderSize - 1);
+    }
+
+
+    bool SocketSharedChannel::fits(size_t size)
+    {
+        size_t record_size = getRecordSize(size);
+        size_t offset = static_cast<size_t>(mSend.mPosition & (mRingCapacity - 1));
+        size_t contiguous = mRingCapacity - offset;
+        size_t required = record_size <= contiguous ? record_size : contiguous + record_size;
+
+        // refresh the read position of the consumer only when the cached one says the ring is full
+        if(mRingCapacity - static_cast<size_t>(mSend.mPosition - mSend.mCachedPosition) < required)
+            mSend.mCachedPosition = mSend.mHeader->mHead.load(std::memory_order_acquire);
+        return mRingCapacity - static_cast<size_t>(mSend.mPosition - mSend.mCachedPosition) >= required;
+    }
+
+
+    bool SocketSharedChannel::write(const char* data, size_t size)
+    {
+        if(mSegment == nullptr || size > getMaxMessageSize())
+            return false;
+
+        size_t record_size = getRecordSize(size);
+        size_t offset = static_cast<size_t>(mSend.mPosition & (mRingCapacity - 1));
+        size_t contiguous = mRingCapacity - offset;
+        if(!fits(size))
+        {
+            // the record doesn't fit before the end of an otherwise empty ring, skip to the start once the consumer
+            // passed the end so the record fits next time
+            size_t free = mRingCapacity - static_cast<size_t>(mSend.mPosition - mSend.mCachedPosition);
+            if(record_size > contiguous && free >= contiguous)
+            {
+                uint32 marker = sWrapMarker;
+                std::memcpy(mSend.mData + offset, &marker, sizeof(marker));
+                mSend.mPosition += contiguous;
+                mSend.mHeader->mTail.store(mSend.mPosition, std::memory_order_release);
+            }
+            return false;
+        }
+
+        // records never wrap, mark the rest of the ring as unused when the record doesn't fit before the end
+        if(record_size > contiguous)
+        {
+            uint32 marker = sWrapMarker;
+            std::memcpy(mSend.mData + offset, &marker, sizeof(marker));
+            mSend.mPosition += contiguous;
+            offset = 0;
+        }
+
+        uint32 record_header = static_cast<uint32>(size);
+        std::memcpy(mSend.mData + offset, &record_header, sizeof(record_header));
+        std::memcpy(mSend.mData + offset + sRecordHeaderSize, data, size);
+        mSend.mPosition += record_size;
+
+        // publish the record
+        mSend.mHeader->mTail.store(mSend.mPosition, std::memory_order_release);
+        return true;
+    }
+
+
+    bool SocketSharedChannel::read(const std::function<void(const char*, size_t)>& dispatch)
+    {
+        if(mSegment == nullptr)
+            return true;
+
+        while(true)
+        {
+            // refresh the write position of the producer only when the cached one says the ring is empty
+            if(mReceive.mPosition == mReceive.mCachedPosition)
+            {
+                mReceive.mCachedPosition = mReceive.mHeader->mTail.load(std::memory_order_acquire);
+                if(mReceive.mPosition == mReceive.mCachedPosition)
+                    return true;
+            }
+
+            // the peer is not trusted, check every record stays within the published part of the ring
+            size_t available = static_cast<size_t>(mReceive.mCachedPosition - mReceive.mPosition);
+            size_t offset = static_cast<size_t>(mReceive.mPosition & (mRingCapacity - 1));
+            size_t contiguous = mRingCapacity - offset;
+            if(available > mRingCapacity || available < sizeof(uint32))
+                return false;
+
+            uint32 record_header;
+            std::memcpy(&record_header, mReceive.mData + offset, sizeof(record_header));
+            if(record_header == sWrapMarker)
+            {
+                if(available < contiguous)
+                    return false;
+                mReceive.mPosition += contiguous;
+            }else
+            {
+                size_t record_size = getRecordSize(record_header);
+                if(record_header > getMaxMessageSize() || record_size > contiguous || record_size > available)
+                    return false;
+
+                dispatch(mReceive.mData + offset + sRecordHeaderSize, record_header);
+                mReceive.mPosition += record_size;
+            }
+        }
+    }
+
+
+    void SocketSharedChannel::release()
+    {
+        if(mSegment == nullptr)
+            return;
+
+        // hand the space back to the producer, once for all messages read
+        mReceive.mHeader->mHead.store(mReceive.mPosition, std::memory_order_release);
+    }
+
+
+    bool SocketSharedChannel::armRead()
+    {
+        if(mSegment == nullptr)
+            return true;
+
+        // pairs with the fence in shouldNotifyReader(), either the producer sees the flag or we see the message
+        mReceive.mHeader->mReaderWaiting.store(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        mReceive.mCachedPosition = mReceive.mHeader->mTail.load(std::memory_order_acquire);
+        if(mReceive.mPosition == mReceive.mCachedPosition)
+            return true;
+
+        mReceive.mHeader->mReaderWaiting.store(0, std::memory_order_relaxed);
+        return false;
+    }
+
+
+    bool SocketSharedChannel::armWrite(size_t size)
+    {
+        if(mSegment == nullptr)
+            return true;
+
+        // pairs with the fence in shouldNotifyWriter(), either the consumer sees the flag or we see the room
+        mSend.mHeader->mWriterWaiting.store(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if(!fits(size))
+            return true;
+
+        mSend.mHeader->mWriterWaiting.store(0, std::memory_order_relaxed);
+        return false;
+    }
+
+
+    bool SocketSharedChannel::shouldNotifyReader()
+    {
+        if(mSegment == nullptr)
+            return false;
+
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        auto& waiting = mSend.mHeader->mReaderWaiting;
+        return waiting.load(std::memory_order_relaxed) != 0 && waiting.exchange(0, std::memory_order_relaxed) != 0;
+    }
+
+
+    bool SocketSharedChannel::shouldNotifyWriter()
+    {
+        if(mSegment == nullptr)
+            return false;
+
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        auto& waiting = mReceive.mHeader->mWriterWaiting;
+        return waiting.load(std::memory_order_relaxed) != 0 && waiting.exchange(0, std::memory_order_relaxed) != 0;
+    }
+
+
+    void SocketSharedChannel::encodeHandshake(const std::string& name, std::string& handshake)
+    {
+        handshake.push_back(static_cast<char>(name.size()));
+        handshake.append(name);
+    }
+
+
+    bool SocketSharedChannel::decodeHandshake(const char* data, size_t size, std::string& name, size_t& consumed)
+    {
+        consumed = 0;
+        if(size < sHandshakeHeaderSize)
+            return true;
+
+        size_t name_size = static_cast<unsigned char>(data[0]);
+        if(name_size == 0)
+            return false;
+
+        if(size < sHandshakeHeaderSize + name_size)
+            return true;
+
+        name.assign(data + sHandshakeHeaderSize, name_size);
+        consumed = sHandshakeHeaderSize + name_size;
+        return true;
+    }
+}
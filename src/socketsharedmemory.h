@@ -0,0 +1,176 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#pragma once
+
+// External includes
+#include <nap/numeric.h>
+#include <utility/errorstate.h>
+#include <functional>
+#include <string>
+
+namespace nap
+{
+    //////////////////////////////////////////////////////////////////////////
+
+    // shared state of a single ring, defined in socketsharedmemory.cpp
+    struct SocketSharedRingHeader;
+
+    /**
+     * Pair of single producer, single consumer message rings in a shared memory segment, connecting two processes on
+     * the same host. The process creating the channel writes to the first ring and reads from the second, the process
+     * opening it does the opposite. Messages are copied into the ring behind a small size header, so reading and writing
+     * does not involve the kernel at all.
+     * The channel does not wait by itself. A reader that runs out of messages arms a flag with armRead() before going to
+     * sleep, and the writer tests it with shouldNotifyReader() after writing, waking the reader only when it is actually
+     * sleeping. The same goes for a writer waiting for room. SocketClient and SocketServer deliver these wake ups as
+     * single bytes over the local stream socket that set up the channel.
+     */
+    class NAPAPI SocketSharedChannel final
+    {
+    public:
+        static constexpr size_t sMinRingCapacity    = 4096;
+
+        SocketSharedChannel() = default;
+        ~SocketSharedChannel();
+
+        SocketSharedChannel(const SocketSharedChannel&) = delete;
+        SocketSharedChannel& operator=(const SocketSharedChannel&) = delete;
+
+        /**
+         * Creates a new shared memory segment holding both rings, pass getName() to the peer to open it
+         * @param ringCapacity capacity of each ring in bytes, rounded up to a power of two of at least sMinRingCapacity
+         * @param errorState contains the error when the segment can't be created
+         * @return true on success
+         */
+        bool create(size_t ringCapacity, utility::ErrorState& errorState);
+
+        /**
+         * Opens a segment created by the peer. The name of the segment is removed afterwards, the memory is released
+         * once both processes closed the channel
+         * @param name name of the segment, see getName()
+         * @param errorState contains the error when the segment can't be opened or is not a valid channel
+         * @return true on success
+         */
+        bool open(const std::string& name, utility::ErrorState& errorState);
+
+        /**
+         * Unmaps the segment, removes its name when the channel was created by this process and not opened by the peer
+         */
+        void close();
+
+        /**
+         * @return whether the channel is created or opened
+         */
+        bool isOpen() const                                 { return mSegment != nullptr; }
+
+        /**
+         * @return name of the shared memory segment
+         */
+        const std::string& getName() const                  { return mName; }
+
+        /**
+         * @return size in bytes of the largest message that fits in a ring
+         */
+        size_t getMaxMessageSize() const;
+
+        /**
+         * Copies a message into the outgoing ring
+         * @param data the message
+         * @param size size of the message in bytes, at most getMaxMessageSize()
+         * @return false when the ring has no room for the message
+         */
+        bool write(const char* data, size_t size);
+
+        /**
+         * Reads all messages in the incoming ring. The space of the messages is not handed back to the peer until
+         * release() is called, so at most a ring full of messages is read before that
+         * @param dispatch called for every message, the data stays valid until release()
+         * @return false when the ring holds data that is not a valid message
+         */
+        bool read(const std::function<void(const char*, size_t)>& dispatch);
+
+        /**
+         * Hands the space of the messages read so far back to the peer, call after read() and before shouldNotifyWriter()
+         */
+        void release();
+
+        /**
+         * Asks the peer to wake this process up when it writes a message, call after read() returned
+         * @return false when a message arrived in the meantime, read again instead of going to sleep
+         */
+        bool armRead();
+
+        /**
+         * Asks the peer to wake this process up when it makes room, call after write() failed
+         * @param size size in bytes of the message waiting for room
+         * @return false when room was made in the meantime, write again instead of going to sleep
+         */
+        bool armWrite(size_t size);
+
+        /**
+         * Call after writing messages
+         * @return whether the peer is waiting for messages and must be woken up
+         */
+        bool shouldNotifyReader();
+
+        /**
+         * Call after releasing read messages
+         * @return whether the peer is waiting for room and must be woken up
+         */
+        bool shouldNotifyWriter();
+
+        /**
+         * Appends the handshake passing the name of the segment to the peer
+         * @param name name of the segment
+         * @param handshake the handshake is appended to this string
+         */
+        static void encodeHandshake(const std::string& name, std::string& handshake);
+
+        /**
+         * Decodes the handshake sent by the peer
+         * @param data received data
+         * @param size number of received bytes
+         * @param name the decoded name of the segment
+         * @param consumed number of bytes of the handshake, 0 when the handshake is not complete yet
+         * @return false when the data is not a valid handshake
+         */
+        static bool decodeHandshake(const char* data, size_t size, std::string& name, size_t& consumed);
+    private:
+        /**
+         * One direction of the channel
+         */
+        struct Ring
+        {
+            SocketSharedRingHeader* mHeader = nullptr;
+            char*                   mData = nullptr;
+            uint64                  mPosition = 0;          ///< write position of the producer or read position of the consumer
+            uint64                  mCachedPosition = 0;    ///< last seen position of the other end
+        };
+
+        /**
+         * Maps the rings in the segment
+         * @param creator whether this process created the segment
+         */
+        void attach(bool creator);
+
+        /**
+         * @return number of bytes a message of the given size occupies in a ring, excluding wrap around
+         */
+        size_t getRecordSize(size_t size) const;
+
+        /**
+         * @return whether a message of the given size fits in the outgoing ring
+         */
+        bool fits(size_t size);
+
+        std::string     mName;
+        char*           mSegment = nullptr;
+        size_t          mSegmentSize = 0;
+        size_t          mRingCapacity = 0;
+        bool            mUnlinkOnClose = false;
+        Ring            mSend;
+        Ring            mReceive;
+    };
+}
@@ -7,19 +7,43 @@
 #include "socketservice.h"
 
 #include <nap/logger.h>
+#include <asio/version.hpp>
+#include <future>
+#include <limits>
+
+// older asio versions silently ignore ASIO_HAS_IO_URING and keep using epoll
+#if defined(ASIO_HAS_IO_URING) && ASIO_VERSION < 102100
+#error "The io_uring backend requires asio 1.21 or newer"
+#endif
 
 using asio::ip::address;
 using asio::ip::tcp;
 using namespace std::chrono_literals;
 
+namespace nap
+{
+	// the SocketThread running a processing pass on the calling thread
+	static thread_local const SocketThread* sPassThread = nullptr;
+
+	// the SocketThread that owns the calling thread, set once when a spawned or worker thread starts
+	static thread_local const SocketThread* sOwnerThread = nullptr;
+}
+
 RTTI_BEGIN_ENUM(nap::ESocketThreadUpdateMethod)
 	RTTI_ENUM_VALUE(nap::ESocketThreadUpdateMethod::MAIN_THREAD, 		"Main Thread"),
 	RTTI_ENUM_VALUE(nap::ESocketThreadUpdateMethod::SPAWN_OWN_THREAD, 	"Spawn Own Thread"),
-	RTTI_ENUM_VALUE(nap::ESocketThreadUpdateMethod::MANUAL, 			"Manual")
+	RTTI_ENUM_VALUE(nap::ESocketThreadUpdateMethod::MANUAL, 			"Manual"),
+	RTTI_ENUM_VALUE(nap::ESocketThreadUpdateMethod::EVENT_DRIVEN, 		"Event Driven")
 RTTI_END_ENUM
 
 RTTI_BEGIN_CLASS_NO_DEFAULT_CONSTRUCTOR(nap::SocketThread)
 	RTTI_PROPERTY("Update Method", 	&nap::SocketThread::mUpdateMethod, nap::rtti::EPropertyMetaData::Default)
+	RTTI_PROPERTY("Process Interval", 	&nap::SocketThread::mProcessIntervalMillis, nap::rtti::EPropertyMetaData::Default)
+	RTTI_PROPERTY("Worker Count", 		&nap::SocketThread::mWorkerCount, nap::rtti::EPropertyMetaData::Default)
+	RTTI_PROPERTY("Enable Metrics", 	&nap::SocketThread::mEnableMetrics, nap::rtti::EPropertyMetaData::Default)
+	RTTI_PROPERTY("Metrics Log Interval", &nap::SocketThread::mMetricsLogIntervalMillis, nap::rtti::EPropertyMetaData::Default)
+	RTTI_PROPERTY("Process Budget", 	&nap::SocketThread::mProcessBudgetMillis, nap::rtti::EPropertyMetaData::Default)
+	RTTI_PROPERTY("Process Budget Handlers", &nap::SocketThread::mProcessBudgetHandlers, nap::rtti::EPropertyMetaData::Default)
 RTTI_END_CLASS
 
 namespace nap
@@ -39,6 +63,16 @@ namespace nap
 
     bool SocketThread::init(utility::ErrorState &errorState)
     {
+        if(!errorState.check(mWorkerCount >= 0, "Worker Count cannot be negative"))
+            return false;
+
+        if(!errorState.check(mProcessBudgetMillis >= 0.0f && mProcessBudgetHandlers >= 0, "Process budget cannot be negative"))
+            return false;
+
+        // create worker services upfront, adapters might request them before the thread is started
+        for(int i = 0; i < mWorkerCount; i++)
+            mWorkerServices.emplace_back(std::make_unique<asio::io_service>());
+
         return true;
     }
 
@@ -46,13 +80,26 @@ namespace nap
 	bool SocketThread::start(utility::ErrorState& errorState)
 	{
         mRun.store(true);
+        mStartTime = std::chrono::steady_clock::now();
+        mStartLatencyMicros.store(-1);
+
+        // adapters that survived a restart can be processed right away
+        {
+            auto adapters = getAdapters();
+            std::lock_guard ready_lock(mReadyMutex);
+            mReady = !adapters->empty();
+        }
+
+        startWorkers();
 
 		switch (mUpdateMethod)
 		{
 		case ESocketThreadUpdateMethod::SPAWN_OWN_THREAD:
+		case ESocketThreadUpdateMethod::EVENT_DRIVEN:
             mThread = std::thread([this]
                     {
-                        std::this_thread::sleep_for(2000ms);
+                        sOwnerThread = this;
+                        waitUntilReady();
                         thread();
                     });
 			break;
@@ -76,24 +123,78 @@ namespace nap
 		if(mRun.load())
 		{
             mRun.store(false);
+            signalReady();
 
 			switch (mUpdateMethod)
 			{
 			case ESocketThreadUpdateMethod::SPAWN_OWN_THREAD:
 				mThread.join();
 				break;
+			case ESocketThreadUpdateMethod::EVENT_DRIVEN:
+				// wake up the blocking run() call
+				mIOService.stop();
+				mThread.join();
+				mIOService.restart();
+				break;
 			case ESocketThreadUpdateMethod::MAIN_THREAD:
 				mService.removeSocketThread(this);
 				break;
 			default:
 				break;
 			}
+
+			stopWorkers();
 		}
 	}
 
 
+	void SocketThread::waitUntilReady()
+	{
+		std::unique_lock lock(mReadyMutex);
+		mReadyCondition.wait(lock, [this]() { return mReady || !mRun.load(); });
+	}
+
+
+	void SocketThread::signalReady()
+	{
+		{
+			std::lock_guard lock(mReadyMutex);
+			mReady = true;
+		}
+		mReadyCondition.notify_all();
+	}
+
+
+	void SocketThread::recordStartLatency()
+	{
+		auto latency = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - mStartTime);
+		int64 expected = -1;
+		if(mStartLatencyMicros.compare_exchange_strong(expected, latency.count()))
+		{
+			nap::Logger::debug(*this, utility::stringFormat("Started processing after %.3f ms", static_cast<double>(latency.count()) / 1000.0));
+		}
+	}
+
+
+	double SocketThread::getStartLatency() const
+	{
+		int64 latency = mStartLatencyMicros.load();
+		return latency < 0 ? -1.0 : static_cast<double>(latency) / 1000.0;
+	}
+
+
 	void SocketThread::thread()
 	{
+		if(!mRun.load())
+			return;
+
+		recordStartLatency();
+		if(mUpdateMethod == ESocketThreadUpdateMethod::EVENT_DRIVEN)
+		{
+			runEventLoop();
+			return;
+		}
+
         while (mRun.load())
         {
             process();
@@ -101,25 +202,335 @@ namespace nap
 	}
 
 
+	void SocketThread::runEventLoop()
+	{
+		// keeps run() from returning when there is no pending work
+		auto work_guard = asio::make_work_guard(mIOService);
+
+		// process all adapters once, they will request processing themselves from here on
+		mProcessTimer = std::make_unique<asio::steady_timer>(mIOService);
+		asio::post(mIOService, [this]() { processAdapters(); });
+		scheduleProcessTimer();
+
+		while (mRun.load())
+		{
+			asio::error_code err;
+			mIOService.run(err);
+			if(err)
+			{
+				nap::Logger::error(*this, err.message());
+			}
+
+			// run() returns when stopped, restart when this was not requested by stop()
+			if(mRun.load())
+				mIOService.restart();
+		}
+
+		mProcessTimer.reset();
+	}
+
+
+	void SocketThread::scheduleProcessTimer()
+	{
+		if(mProcessIntervalMillis <= 0)
+			return;
+
+		mProcessTimer->expires_after(std::chrono::milliseconds(mProcessIntervalMillis));
+		mProcessTimer->async_wait([this](const asio::error_code& errorCode)
+		{
+			if(errorCode)
+				return;
+
+			processAdapters();
+			scheduleProcessTimer();
+		});
+	}
+
+
+	void SocketThread::processAdapters()
+	{
+		uint64 pass_start = mEnableMetrics ? SocketMetrics::now() : 0;
+		auto adapters = beginPass();
+		for(auto& adapter : *adapters)
+		{
+			if(isRemovedDuringPass(adapter))
+				continue;
+
+			adapter->mProcessRequested.store(false);
+			processAdapterTimed(adapter);
+		}
+		finishPass(*adapters, pass_start);
+		endPass();
+	}
+
+
+	void SocketThread::requestProcess(SocketAdapter* adapter)
+	{
+		if(mUpdateMethod != ESocketThreadUpdateMethod::EVENT_DRIVEN)
+			return;
+
+		// coalesce requests, a process call is already pending
+		if(adapter->mProcessRequested.exchange(true))
+			return;
+
+		asio::post(mIOService, [this, adapter, registration_id = adapter->mRegistrationID.load()]()
+		{
+			processAdapter(adapter, registration_id);
+		});
+	}
+
+
+	void SocketThread::processAdapter(SocketAdapter* adapter, uint64 registrationID)
+	{
+		uint64 pass_start = mEnableMetrics ? SocketMetrics::now() : 0;
+		auto adapters = beginPass();
+
+		// adapter might have been removed while the request was pending, registered adapters are alive
+		auto found_it = std::find(adapters->begin(), adapters->end(), adapter);
+		if(found_it != adapters->end() && adapter->mRegistrationID.load() == registrationID)
+		{
+			adapter->mProcessRequested.store(false);
+			processAdapterTimed(adapter);
+			finishPass(*adapters, pass_start);
+		}
+		endPass();
+	}
+
+
 	void SocketThread::process()
 	{
-		std::lock_guard lock(mMutex);
+		if(mStartLatencyMicros.load(std::memory_order_relaxed) < 0)
+			recordStartLatency();
+
+		uint64 pass_start = mEnableMetrics ? SocketMetrics::now() : 0;
+		auto adapters = beginPass();
 
         if(mIOService.stopped())
             mIOService.restart();
 
-        for(auto& adapter : mAdapters)
+        // the spawned thread processes as often as it can, a budget only applies to calls from the application
+        bool budgeted = mUpdateMethod != ESocketThreadUpdateMethod::SPAWN_OWN_THREAD &&
+                        (mProcessBudgetMillis > 0.0f || mProcessBudgetHandlers > 0);
+        if(!budgeted)
+        {
+            for(auto& adapter : *adapters)
+            {
+                processAdapterTimed(adapter);
+            }
+
+            asio::error_code err;
+            mIOService.poll(err);
+
+            if(err)
+            {
+                nap::Logger::error(*this, err.message());
+            }
+        }else
         {
-            adapter->process();
+            auto deadline = std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                std::chrono::duration<double, std::milli>(mProcessBudgetMillis));
+
+            // continue with the adapter after the last one processed, every call processes at least one adapter
+            size_t count = adapters->size();
+            size_t first = count > 0 ? mNextAdapter % count : 0;
+            size_t processed = 0;
+            while(processed < count)
+            {
+                processAdapterTimed((*adapters)[(first + processed) % count]);
+                processed++;
+                if(mProcessBudgetMillis > 0.0f && std::chrono::steady_clock::now() >= deadline)
+                    break;
+            }
+            mNextAdapter = count > 0 ? (first + processed) % count : 0;
+
+            pollHandlers(deadline);
         }
 
-        asio::error_code err;
-        mIOService.poll(err);
+        finishPass(*adapters, pass_start);
+        endPass();
+	}
 
-        if(err)
-        {
-            nap::Logger::error(*this, err.message());
-        }
+
+	void SocketThread::pollHandlers(std::chrono::steady_clock::time_point deadline)
+	{
+		size_t max_handlers = mProcessBudgetHandlers > 0 ? static_cast<size_t>(mProcessBudgetHandlers) : std::numeric_limits<size_t>::max();
+		for(size_t handlers = 0; handlers < max_handlers; handlers++)
+		{
+			// handlers that are not run stay queued for the next call
+			if(handlers > 0 && mProcessBudgetMillis > 0.0f && std::chrono::steady_clock::now() >= deadline)
+				break;
+
+			asio::error_code err;
+			if(mIOService.poll_one(err) == 0)
+				break;
+
+			if(err)
+			{
+				nap::Logger::error(*this, err.message());
+				break;
+			}
+		}
+	}
+
+
+	void SocketThread::processAdapterTimed(SocketAdapter* adapter)
+	{
+		// an adapter processed earlier in this pass might have destroyed this one
+		if(isRemovedDuringPass(adapter))
+			return;
+
+		auto* metrics = adapter->getEnabledMetrics();
+		if(metrics == nullptr)
+		{
+			adapter->process();
+			return;
+		}
+
+		uint64 start = SocketMetrics::now();
+		adapter->process();
+		metrics->recordProcess(SocketMetrics::now() - start);
+	}
+
+
+	void SocketThread::finishPass(const AdapterList& adapters, uint64 passStart)
+	{
+		if(passStart != 0)
+			mPassDuration.record(SocketMetrics::now() - passStart);
+
+		if(mMetricsLogIntervalMillis <= 0)
+			return;
+
+		uint64 now = SocketMetrics::now();
+		uint64 interval = static_cast<uint64>(mMetricsLogIntervalMillis) * 1000000;
+		if(mNextMetricsLog == 0)
+			mNextMetricsLog = now + interval;
+		if(now < mNextMetricsLog)
+			return;
+
+		// adapters might be destroyed once the pass ends, their lines are formatted now and logged by endPass()
+		mNextMetricsLog = now + interval;
+		if(mEnableMetrics)
+		{
+			SocketThreadMetricsSnapshot snapshot;
+			snapshot.mAdapterCount = adapters.size();
+			snapshot.mPassDuration = mPassDuration.getSnapshot();
+			mMetricsLog.emplace_back(utility::stringFormat("%s: %s", mID.c_str(), snapshot.toString().c_str()));
+		}
+
+		for(auto& adapter : adapters)
+		{
+			if(!isRemovedDuringPass(adapter) && adapter->mEnableMetrics)
+				mMetricsLog.emplace_back(utility::stringFormat("%s: %s", adapter->mID.c_str(), adapter->getMetrics().toString().c_str()));
+		}
+	}
+
+
+	SocketThreadMetricsSnapshot SocketThread::getMetrics() const
+	{
+		SocketThreadMetricsSnapshot snapshot;
+		snapshot.mAdapterCount = getAdapters()->size();
+		snapshot.mPassDuration = mPassDuration.getSnapshot();
+		return snapshot;
+	}
+
+
+	void SocketThread::startWorkers()
+	{
+		mWorkersRunning.store(true);
+		for(auto& worker_service : mWorkerServices)
+		{
+			auto* service = worker_service.get();
+			mWorkerThreads.emplace_back([this, service]()
+			{
+				sOwnerThread = this;
+
+				// keeps run() from returning when there is no pending work
+				auto work_guard = asio::make_work_guard(*service);
+				while (mWorkersRunning.load())
+				{
+					asio::error_code err;
+					service->run(err);
+					if(err)
+					{
+						nap::Logger::error(*this, err.message());
+					}
+
+					// run() returns when stopped, restart when this was not requested by stopWorkers()
+					if(mWorkersRunning.load())
+						service->restart();
+				}
+			});
+		}
+	}
+
+
+	void SocketThread::stopWorkers()
+	{
+		mWorkersRunning.store(false);
+		for(auto& worker_service : mWorkerServices)
+			worker_service->stop();
+
+		for(auto& worker_thread : mWorkerThreads)
+			worker_thread.join();
+
+		mWorkerThreads.clear();
+		for(auto& worker_service : mWorkerServices)
+			worker_service->restart();
+	}
+
+
+	asio::io_service& SocketThread::getWorkerIOService()
+	{
+		if(mWorkerServices.empty())
+			return mIOService;
+
+		return *mWorkerServices[mNextWorker.fetch_add(1) % mWorkerServices.size()];
+	}
+
+
+	bool SocketThread::isRunByOwnThread(const asio::io_service& service) const
+	{
+		if(&service == &mIOService)
+		{
+			return mRun.load() && (mUpdateMethod == ESocketThreadUpdateMethod::SPAWN_OWN_THREAD ||
+								   mUpdateMethod == ESocketThreadUpdateMethod::EVENT_DRIVEN);
+		}
+
+		return mWorkersRunning.load();
+	}
+
+
+	bool SocketThread::isOwnThread() const
+	{
+		// never reads mThread or mWorkerThreads, these are replaced by start() and stop() while senders may be calling
+		return sOwnerThread == this;
+	}
+
+
+	void SocketThread::waitForHandlers()
+	{
+		std::vector<asio::io_service*> services;
+		for(auto& worker_service : mWorkerServices)
+		{
+			if(isRunByOwnThread(*worker_service))
+				services.emplace_back(worker_service.get());
+		}
+
+		if(isRunByOwnThread(mIOService))
+			services.emplace_back(&mIOService);
+
+		// a handler that cancels operations, for example by closing a socket, queues their completions behind the
+		// first barrier, the second barrier waits for those as well
+		for(int round = 0; round < 2; round++)
+		{
+			for(auto* service : services)
+			{
+				std::promise<void> barrier;
+				auto done = barrier.get_future();
+				asio::post(*service, [&barrier]() { barrier.set_value(); });
+				done.wait();
+			}
+		}
 	}
 
 
@@ -129,23 +540,98 @@ namespace nap
 	}
 
 
+	std::shared_ptr<const SocketThread::AdapterList> SocketThread::beginPass()
+	{
+		sPassThread = this;
+		std::lock_guard lock(mAdaptersMutex);
+		mPassSequence++;
+		return mAdapters;
+	}
+
+
+	void SocketThread::endPass()
+	{
+		{
+			std::lock_guard lock(mAdaptersMutex);
+			mPassSequence++;
+		}
+		mPassCondition.notify_all();
+		sPassThread = nullptr;
+		mRemovedDuringPass.clear();
+
+		for(auto& line : mMetricsLog)
+			nap::Logger::info(line);
+		mMetricsLog.clear();
+	}
+
+
+	bool SocketThread::isRemovedDuringPass(const SocketAdapter* adapter) const
+	{
+		return !mRemovedDuringPass.empty() &&
+			std::find(mRemovedDuringPass.begin(), mRemovedDuringPass.end(), adapter) != mRemovedDuringPass.end();
+	}
+
+
+	void SocketThread::waitForPass()
+	{
+		// a pass can't wait for itself to end
+		if(sPassThread == this)
+			return;
+
+		std::unique_lock lock(mAdaptersMutex);
+		uint64 sequence = mPassSequence;
+		if((sequence & 1) == 0)
+			return;
+
+		mPassCondition.wait(lock, [this, sequence]() { return mPassSequence != sequence; });
+	}
+
+
+	std::shared_ptr<const SocketThread::AdapterList> SocketThread::getAdapters() const
+	{
+		std::lock_guard lock(mAdaptersMutex);
+		return mAdapters;
+	}
+
+
 	void SocketThread::removeAdapter(SocketAdapter * adapter)
 	{
-		std::lock_guard lock(mMutex);
+		{
+			std::lock_guard lock(mAdaptersMutex);
+			auto adapters = std::make_shared<AdapterList>(*mAdapters);
+			auto found_it = std::find_if(adapters->begin(), adapters->end(), [&](const auto& it)
+				{
+					return it == adapter;
+				});
+			assert(found_it != adapters->end());
+			adapters->erase(found_it);
+			mAdapters = std::move(adapters);
+			adapter->mRegistrationID.store(0);
+		}
 
-		auto found_it = std::find_if(mAdapters.begin(), mAdapters.end(), [&](const auto& it)
-			{
-				return it == adapter;
-			});
-		assert(found_it != mAdapters.end());
-		mAdapters.erase(found_it);
+		// removed from within a pass, the snapshot of the pass still holds the adapter and skips it from now on
+		if(sPassThread == this)
+		{
+			mRemovedDuringPass.emplace_back(adapter);
+			return;
+		}
+
+		// the pass that is running on another thread might still process the adapter
+		waitForPass();
 	}
 
 
 	void SocketThread::registerAdapter(SocketAdapter * adapter)
 	{
-		std::lock_guard lock(mMutex);
+		{
+			std::lock_guard lock(mAdaptersMutex);
+			auto adapters = std::make_shared<AdapterList>(*mAdapters);
+			adapters->emplace_back(adapter);
+			mAdapters = std::move(adapters);
+			adapter->mRegistrationID.store(mNextRegistrationID++);
+		}
 
-		mAdapters.emplace_back(adapter);
+		// the spawned thread starts processing once there is an adapter to process
+		signalReady();
 	}
 }
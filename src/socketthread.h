@@ -9,17 +9,25 @@
 #include <nap/resource.h>
 #include <nap/device.h>
 #include <thread>
+#include <condition_variable>
+#include <chrono>
+#include <memory>
+#include <vector>
 
 // NAP includes
 #include <nap/numeric.h>
 #include <concurrentqueue.h>
 #include <rtti/factory.h>
 
+// Local includes
+#include "socketmetrics.h"
+
 // ASIO includes
 #include <asio/ts/buffer.hpp>
 #include <asio/ts/internet.hpp>
 #include <asio/io_service.hpp>
 #include <asio/system_error.hpp>
+#include <asio/steady_timer.hpp>
 
 namespace nap
 {
@@ -29,7 +37,8 @@ namespace nap
 	{
 		MAIN_THREAD			= 0,
 		SPAWN_OWN_THREAD	= 1,
-		MANUAL				= 2
+		MANUAL				= 2,
+		EVENT_DRIVEN		= 3
 	};
 
 	// forward declares
@@ -43,6 +52,15 @@ namespace nap
      * or create it's own thread that will call process() on any SocketAdapters that use this SocketThread. You can also
      * choose to update the SocketThread manually in which case you need to call manualProcess() yourself from some point
      * in your application. This is useful when wanting to sync the process loop to other running threads in your application.
+     * When the update method is EVENT_DRIVEN the SocketThread spawns its own thread that blocks in asio::io_service::run()
+     * and only wakes up when a socket, timer or posted action is ready. Adapters are processed as posted handlers when they
+     * request it, see SocketAdapter::requestProcess(), or when the process interval elapses.
+     * Additionally a pool of worker threads can be created by setting 'Worker Count'. Every worker runs its own
+     * asio::io_service, adapters can distribute work over the pool using SocketAdapter::getWorkerIOService().
+     * On Linux the module can be built with NAPSOCKET_USE_IO_URING, every io_service then submits socket operations
+     * through io_uring instead of the epoll reactor. Reads and writes of SocketServer connections are asynchronous
+     * operations and map directly to io_uring requests, this works best with the EVENT_DRIVEN update method where a
+     * single wait reaps all completed operations.
      */
 	class NAPAPI SocketThread : public Device
 	{
@@ -50,6 +68,8 @@ namespace nap
 		friend class SocketAdapter;
 
 		RTTI_ENABLE(Device)
+
+		using AdapterList = std::vector<SocketAdapter*>;
 	public:
 		/**
 		 * Constructor
@@ -73,12 +93,36 @@ namespace nap
 	public:
 		// properties
 		ESocketThreadUpdateMethod mUpdateMethod = ESocketThreadUpdateMethod::MAIN_THREAD; ///< Property: 'Update Method' the way the SocketThread should process adapters
+		int mProcessIntervalMillis = 100; ///< Property: 'Process Interval' EVENT_DRIVEN only, interval at which all adapters are processed when idle, 0 disables the interval
+		int mWorkerCount = 0; ///< Property: 'Worker Count' number of worker threads, each running its own asio::io_service. 0 handles all work on this SocketThread
+		bool mEnableMetrics = false; ///< Property: 'Enable Metrics' whether the duration of processing passes is recorded, see getMetrics()
+		int mMetricsLogIntervalMillis = 0; ///< Property: 'Metrics Log Interval' interval at which the metrics of this thread and its adapters are logged, 0 disables logging
+		float mProcessBudgetMillis = 0.0f; ///< Property: 'Process Budget' MAIN_THREAD and MANUAL only, time in milliseconds a process call may spend on adapters and handlers, remaining work is carried over to the next call. 0 is unlimited
+		int mProcessBudgetHandlers = 0; ///< Property: 'Process Budget Handlers' MAIN_THREAD and MANUAL only, maximum number of completion handlers, like reads dispatching received messages, run by a process call. 0 is unlimited
 
 		/**
 		 * Call this when update method is set to manual.
 		 * If the update method is MAIN_THREAD or SPAWN_OWN_THREAD, this function will not do anything.
 		 */
 		void manualProcess();
+
+		/**
+		 * Returns the time between start() and the first time the adapters are processed. When the SocketThread
+		 * spawns its own thread, processing starts as soon as the first adapter is registered.
+		 * @return start latency in milliseconds, negative when the adapters have not been processed yet
+		 */
+		double getStartLatency() const;
+
+		/**
+		 * Returns the duration of the processing passes, only recorded when 'Enable Metrics' is set. Thread-safe
+		 * @return snapshot of the metrics
+		 */
+		SocketThreadMetricsSnapshot getMetrics() const;
+
+		/**
+		 * Resets the recorded pass durations. Thread-safe
+		 */
+		void resetMetrics()									{ mPassDuration.reset(); }
 	private:
 		/**
 		 * the threaded function
@@ -86,18 +130,120 @@ namespace nap
 		void thread();
 
 		/**
-		 * the process method, will call process on any registered adapter
+		 * the event driven thread function, blocks in asio::io_service::run() until stopped
+		 */
+		void runEventLoop();
+
+		/**
+		 * Schedules the next process interval timer, only used when update method is EVENT_DRIVEN
+		 */
+		void scheduleProcessTimer();
+
+		/**
+		 * Blocks the spawned thread until there is an adapter to process or the SocketThread is stopped
+		 */
+		void waitUntilReady();
+
+		/**
+		 * Releases the spawned thread waiting in waitUntilReady(). Thread-safe
+		 */
+		void signalReady();
+
+		/**
+		 * Records the start latency on the first processing pass after start()
+		 */
+		void recordStartLatency();
+
+		/**
+		 * Calls process on all registered adapters, only used when update method is EVENT_DRIVEN
+		 */
+		void processAdapters();
+
+		/**
+		 * Posts a process call for the given adapter to the asio::io_service. Only has effect when the update method is
+		 * EVENT_DRIVEN. Multiple requests are coalesced into a single process call. Thread-safe
+		 * @param adapter pointer to the socket adapter
+		 */
+		void requestProcess(SocketAdapter* adapter);
+
+		/**
+		 * Calls process on the given adapter when it is still registered, only used when update method is EVENT_DRIVEN.
+		 * The adapter is identified by its registration, an adapter created at the address of a removed one is skipped
+		 * @param adapter pointer to the socket adapter
+		 * @param registrationID the registration of the adapter at the time of the request
+		 */
+		void processAdapter(SocketAdapter* adapter, uint64 registrationID);
+
+		/**
+		 * the process method, will call process on any registered adapter and run the ready handlers.
+		 * With a process budget the call returns once the budget is spent, the next call continues with the adapters
+		 * that were skipped and the handlers that are still queued
 		 */
 		void process();
 
+		/**
+		 * Runs ready handlers of the asio::io_service until none are left or the budget is spent, at least one
+		 * handler runs when one is ready
+		 * @param deadline end of the time budget, only used when a time budget is set
+		 */
+		void pollHandlers(std::chrono::steady_clock::time_point deadline);
+
+		/**
+		 * Calls process on the adapter, recording its duration when the adapter has metrics enabled
+		 * @param adapter pointer to the socket adapter
+		 */
+		void processAdapterTimed(SocketAdapter* adapter);
+
+		/**
+		 * Records the duration of a processing pass and gathers the metrics to log when the log interval elapsed,
+		 * endPass() logs them
+		 * @param adapters the adapters processed by the pass
+		 * @param passStart start of the pass, see SocketMetrics::now(), 0 when metrics are disabled
+		 */
+		void finishPass(const AdapterList& adapters, uint64 passStart);
+
+		/**
+		 * Starts a processing pass. The pass works on a snapshot of the registered adapters, adapters added or removed
+		 * while it runs are picked up by the next pass
+		 * @return the adapters to process
+		 */
+		std::shared_ptr<const AdapterList> beginPass();
+
+		/**
+		 * Ends the processing pass started by beginPass(), releases adapters waiting in waitForPass() and logs the
+		 * metrics gathered by finishPass() afterwards, so slow logging never holds up the removal of an adapter
+		 */
+		void endPass();
+
+		/**
+		 * Blocks until the processing pass running on another thread, if any, has ended. Returns immediately when
+		 * called from within a pass of this thread
+		 */
+		void waitForPass();
+
+		/**
+		 * Returns whether the adapter was removed by the pass that is running on the calling thread. The snapshot of
+		 * the pass still holds these adapters, they must not be touched anymore
+		 * @param adapter pointer to the socket adapter
+		 * @return whether the adapter was removed during the current pass
+		 */
+		bool isRemovedDuringPass(const SocketAdapter* adapter) const;
+
+		/**
+		 * @return snapshot of the registered adapters. Thread-safe
+		 */
+		std::shared_ptr<const AdapterList> getAdapters() const;
+
         /**
-         * Register a socket adapter. Thread-safe
+         * Register a socket adapter, it is processed from the next pass on. Thread-safe
          * @param adapter pointer to the socket adapter
          */
 		void registerAdapter(SocketAdapter* adapter);
 
 		/**
-		 * Removes an adapter. Thread-safe
+		 * Removes an adapter. Returns once the adapter is no longer processed, which might mean waiting for the pass
+		 * that is running on another thread. An adapter removed from within a pass is skipped for the rest of that
+		 * pass. Thread-safe
 		 * @param adapter pointer to the socket adapter
 		 */
 		void removeAdapter(SocketAdapter* adapter);
@@ -108,20 +254,84 @@ namespace nap
          */
         asio::io_service& getIOService(){ return mIOService; }
 
+        /**
+         * Returns the next worker asio::io_service in round robin order.
+         * Returns the asio::io_service of this thread when no workers are configured. Thread-safe
+         * @return reference to worker asio::io_service
+         */
+        asio::io_service& getWorkerIOService();
+
+        /**
+         * Returns whether the given asio::io_service is run by a thread owned by this SocketThread, being a worker or
+         * the thread spawned when the update method is SPAWN_OWN_THREAD or EVENT_DRIVEN
+         * @param service the asio::io_service to check
+         * @return whether the asio::io_service is run by a thread owned by this SocketThread
+         */
+        bool isRunByOwnThread(const asio::io_service& service) const;
+
+        /**
+         * @return whether the calling thread is owned by this SocketThread, being a worker or the spawned thread
+         */
+        bool isOwnThread() const;
+
+        /**
+         * Blocks until all handlers posted before this call, and the completions of operations these handlers
+         * cancelled, have completed on the asio::io_services that are run by threads owned by this SocketThread, see
+         * isRunByOwnThread(). Must not be called from one of these threads
+         */
+        void waitForHandlers();
+
+        /**
+         * Starts all worker threads
+         */
+        void startWorkers();
+
+        /**
+         * Stops and joins all worker threads
+         */
+        void stopWorkers();
+
 		// threading
 		std::thread 										mThread;
-		std::mutex											mMutex;
 		std::atomic_bool 									mRun = { false };
 		std::function<void()> 								mManualProcessFunc;
 
+		// readiness handshake
+		std::mutex											mReadyMutex;
+		std::condition_variable								mReadyCondition;
+		bool												mReady = false;
+		std::chrono::steady_clock::time_point				mStartTime;
+		std::atomic<int64>									mStartLatencyMicros = { -1 };
+
 		// service
         SocketService& 				mService;
 
-		// adapters
-		std::vector<SocketAdapter*> 	mAdapters;
+		// adapters, passes process an immutable snapshot that is replaced when adapters are added or removed. The mutex
+		// only guards swapping the snapshot and is never held during a pass
+		mutable std::mutex						mAdaptersMutex;
+		std::shared_ptr<const AdapterList>		mAdapters = std::make_shared<const AdapterList>();
+		uint64									mPassSequence = 0;			///< odd while a pass is running, guarded by mAdaptersMutex
+		std::condition_variable					mPassCondition;				///< signalled when a pass ends
+		std::vector<const SocketAdapter*>		mRemovedDuringPass;			///< adapters removed from within the running pass, only used by the pass thread
+		uint64									mNextRegistrationID = 1;	///< guarded by mAdaptersMutex
+
+		// metrics
+		SocketLatencyHistogram			mPassDuration;
+		uint64							mNextMetricsLog = 0;
+		std::vector<std::string>		mMetricsLog;
+
+		// process budget
+		size_t							mNextAdapter = 0;		///< adapter the next budgeted process call starts with
 
         // io service
         asio::io_service 			mIOService;
+        std::unique_ptr<asio::steady_timer> mProcessTimer;
+
+        // workers
+        std::vector<std::unique_ptr<asio::io_service>> 	mWorkerServices;
+        std::vector<std::thread> 						mWorkerThreads;
+        std::atomic_bool 								mWorkersRunning = { false };
+        std::atomic<size_t> 							mNextWorker = { 0 };
 	};
 
 	// Object creator used for constructing the Socket thread
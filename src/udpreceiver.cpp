@@ -0,0 +1,298 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#include "udpreceiver.h"
+#include "socketthread.h"
+
+// External includes
+#include <nap/logger.h>
+#include <algorithm>
+
+#ifdef __linux__
+#include <cerrno>
+#endif
+
+using asio::ip::udp;
+
+RTTI_BEGIN_CLASS(nap::UdpReceiver)
+    RTTI_PROPERTY("Port",                       &nap::UdpReceiver::mPort,                       nap::rtti::EPropertyMetaData::Default)
+    RTTI_PROPERTY("IP Address",                 &nap::UdpReceiver::mIPAddress,                  nap::rtti::EPropertyMetaData::Default)
+    RTTI_PROPERTY("Max Datagram Size",          &nap::UdpReceiver::mMaxDatagramSize,            nap::rtti::EPropertyMetaData::Default)
+    RTTI_PROPERTY("Batch Size",                 &nap::UdpReceiver::mBatchSize,                  nap::rtti::EPropertyMetaData::Default)
+    RTTI_PROPERTY("Socket Receive Buffer Size", &nap::UdpReceiver::mSocketReceiveBufferSize,    nap::rtti::EPropertyMetaData::Default)
+    RTTI_PROPERTY("Enable Log",                 &nap::UdpReceiver::mEnableLog,                  nap::rtti::EPropertyMetaData::Default)
+RTTI_END_CLASS
+
+namespace nap
+{
+    // maximum number of batches received before other handlers get a chance to run
+    static constexpr int sMaxBatchesPerDrain = 16;
+
+    //////////////////////////////////////////////////////////////////////////
+    // UdpReceiver
+    //////////////////////////////////////////////////////////////////////////
+
+    bool UdpReceiver::init(utility::ErrorState& errorState)
+    {
+        // when asio error occurs, init_success indicates whether initialization should fail or succeed
+        bool init_success = false;
+        asio::error_code asio_error_code;
+
+        if(!errorState.check(mMaxDatagramSize > 0 && mBatchSize > 0, "Max Datagram Size and Batch Size must be larger than 0"))
+            return false;
+
+        // when address property is left empty, bind to any local address
+        asio::ip::address address;
+        if (mIPAddress.empty())
+        {
+            address = asio::ip::address_v4::any();
+        } else
+        {
+            address = asio::ip::make_address(mIPAddress, asio_error_code);
+            if (handleAsioError(asio_error_code, errorState, init_success))
+                return init_success;
+        }
+
+        // create and bind socket
+        mSocket = std::make_unique<udp::socket>(getIOService());
+        udp::endpoint endpoint(address, mPort);
+        mSocket->open(endpoint.protocol(), asio_error_code);
+        if (handleAsioError(asio_error_code, errorState, init_success))
+            return init_success;
+
+        mSocket->set_option(udp::socket::reuse_address(true), asio_error_code);
+        if (handleAsioError(asio_error_code, errorState, init_success))
+            return init_success;
+
+        if(mSocketReceiveBufferSize > 0)
+        {
+            mSocket->set_option(asio::socket_base::receive_buffer_size(mSocketReceiveBufferSize), asio_error_code);
+            if (handleAsioError(asio_error_code, errorState, init_success))
+                return init_success;
+        }
+
+        mSocket->bind(endpoint, asio_error_code);
+        if (handleAsioError(asio_error_code, errorState, init_success))
+            return init_success;
+
+        // the socket is drained until it would block
+        mSocket->non_blocking(true, asio_error_code);
+        if (handleAsioError(asio_error_code, errorState, init_success))
+            return init_success;
+
+        // one pooled buffer holds the whole batch, receive fewer datagrams at once rather than allocating the batch
+        // outside of the pool
+        size_t datagram_size = static_cast<size_t>(mMaxDatagramSize);
+        size_t batch_size = static_cast<size_t>(mBatchSize);
+        size_t max_batch_size = std::max<size_t>(SocketBufferPool::sMaxBlockSize / datagram_size, 1);
+        if(batch_size > max_batch_size)
+        {
+            nap::Logger::warn(*this, utility::stringFormat("Batch Size of %d exceeds the buffer pool, receiving %d datagrams at once",
+                                                           mBatchSize, static_cast<int>(max_batch_size)));
+            batch_size = max_batch_size;
+        }
+        mBuffer = SocketBuffer(datagram_size * batch_size);
+        mReceivedSizes.resize(batch_size);
+
+#ifdef __linux__
+        mMessageHeaders.resize(batch_size);
+        mMessageVectors.resize(batch_size);
+        for(size_t i = 0; i < batch_size; i++)
+        {
+            mMessageVectors[i].iov_base = mBuffer.data() + i * datagram_size;
+            mMessageVectors[i].iov_len = datagram_size;
+            mMessageHeaders[i] = {};
+            mMessageHeaders[i].msg_hdr.msg_iov = &mMessageVectors[i];
+            mMessageHeaders[i].msg_hdr.msg_iovlen = 1;
+        }
+#endif
+
+        // init the adapter
+        if(!SocketAdapter::init(errorState))
+            return false;
+
+        // start receiving on the thread of the adapter, the handler might run after the receiver is destroyed
+        asio::post(getIOService(), [this, closed = mClosed]()
+        {
+            if(!closed->load())
+                receiveNext();
+        });
+
+        return true;
+    }
+
+
+    void UdpReceiver::onDestroy()
+    {
+        SocketAdapter::onDestroy();
+
+        // initialization failed before the socket was created
+        mClosed->store(true);
+        if(mSocket == nullptr)
+            return;
+
+        // close the socket on the thread handling it, cancels the pending wait
+        auto* socket = mSocket.get();
+        auto close = [socket]()
+        {
+            asio::error_code asio_error_code;
+            socket->close(asio_error_code);
+        };
+
+        if(isRunByOwnThread(getIOService()))
+        {
+            asio::post(getIOService(), close);
+        }else
+        {
+            close();
+        }
+
+        // make sure no other thread is still handling the socket
+        waitForHandlers();
+    }
+
+
+    void UdpReceiver::process()
+    {
+        // datagrams are received asynchronously by the io_service of the thread
+    }
+
+
+    void UdpReceiver::receiveNext()
+    {
+        mSocket->async_wait(udp::socket::wait_read, [this, closed = mClosed](const asio::error_code& errorCode)
+        {
+            // socket closed, receiver might be destroyed
+            if(errorCode == asio::error::operation_aborted || closed->load())
+                return;
+
+            if(errorCode)
+            {
+                logError(errorCode.message());
+            }else
+            {
+                auto err = drain();
+                if(err)
+                    logError(err.message());
+            }
+
+            receiveNext();
+        });
+    }
+
+
+    asio::error_code UdpReceiver::drain()
+    {
+        size_t datagram_size = static_cast<size_t>(mMaxDatagramSize);
+        for(int batch = 0; batch < sMaxBatchesPerDrain; batch++)
+        {
+            size_t count = 0;
+            auto err = receiveBatch(count);
+            for(size_t i = 0; i < count; i++)
+                dispatch(mBuffer.data() + i * datagram_size, mReceivedSizes[i]);
+            deliverReceivedBatch();
+
+            if(err == asio::error::would_block || err == asio::error::try_again)
+                return {};
+
+            if(err || count < mReceivedSizes.size())
+                return err;
+        }
+        return {};
+    }
+
+
+    asio::error_code UdpReceiver::receiveBatch(size_t& count)
+    {
+        count = 0;
+
+#ifdef __linux__
+        int received = ::recvmmsg(mSocket->native_handle(), mMessageHeaders.data(), static_cast<unsigned int>(mMessageHeaders.size()), MSG_DONTWAIT, nullptr);
+        if(received < 0)
+            return asio::error_code(errno, asio::error::get_system_category());
+
+        count = static_cast<size_t>(received);
+        for(size_t i = 0; i < count; i++)
+        {
+            if((mMessageHeaders[i].msg_hdr.msg_flags & MSG_TRUNC) != 0)
+                logError(utility::stringFormat("Datagram larger than %d bytes truncated", mMaxDatagramSize));
+            mReceivedSizes[i] = mMessageHeaders[i].msg_len;
+        }
+        return {};
+#else
+        // one datagram per system call, the socket is non-blocking
+        size_t datagram_size = static_cast<size_t>(mMaxDatagramSize);
+        asio::error_code err;
+        while(count < mReceivedSizes.size())
+        {
+            size_t received = mSocket->receive(asio::buffer(mBuffer.data() + count * datagram_size, datagram_size), 0, err);
+            if(err)
+                break;
+
+            mReceivedSizes[count++] = received;
+        }
+
+        // return the datagrams received before the error, the error is reported by the next batch
+        return count > 0 ? asio::error_code() : err;
+#endif
+    }
+
+
+    void UdpReceiver::dispatch(const char* data, size_t size)
+    {
+        recordReceived(size);
+        if(batchMessage(mReceivedBatch, data, size))
+            return;
+
+        if(isDeliveredOnMainThread())
+        {
+            // the batch buffer is reused by the next receive, the main thread gets a pooled copy
+            deliver(SocketEvent(static_cast<int>(EEvent::MESSAGE), 0, data, size));
+            return;
+        }
+
+        triggerMessage(data, size, mReceivedMessage);
+    }
+
+
+    void UdpReceiver::deliverReceivedBatch()
+    {
+        deliverBatch(mReceivedBatch, static_cast<int>(EEvent::MESSAGE_BATCH), 0);
+    }
+
+
+    void UdpReceiver::triggerEvent(const SocketEvent& event)
+    {
+        switch(static_cast<EEvent>(event.mType))
+        {
+        case EEvent::MESSAGE:
+            triggerMessage(event.mData, event.mSize, mDeliveredMessage);
+            break;
+        case EEvent::MESSAGE_BATCH:
+            messageBatchReceived.trigger(getEventBatch(event));
+            break;
+        }
+    }
+
+
+    void UdpReceiver::triggerMessage(const char* data, size_t size, std::string& message)
+    {
+        messageViewReceived.trigger(std::string_view(data, size));
+        if(!mCopyReceivedMessages)
+            return;
+
+        // reuse the capacity of the previous message
+        message.assign(data, size);
+        messageReceived.trigger(message);
+    }
+
+
+    void UdpReceiver::logError(const std::string& message)
+    {
+        if(mEnableLog)
+        {
+            nap::Logger::error(*this, message);
+        }
+    }
+}
@@ -0,0 +1,157 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#pragma once
+
+// External includes
+#include <string_view>
+#include <vector>
+
+#ifdef __linux__
+#include <sys/socket.h>
+#include <sys/uio.h>
+#endif
+
+// NAP includes
+#include <nap/signalslot.h>
+
+// ASIO includes
+#include <asio/ts/buffer.hpp>
+#include <asio/ts/internet.hpp>
+#include <asio/io_service.hpp>
+#include <asio/system_error.hpp>
+
+// Local includes
+#include "socketadapter.h"
+#include "socketpayload.h"
+
+namespace nap
+{
+    //////////////////////////////////////////////////////////////////////////
+
+    /**
+     * UdpReceiver binds a asio::ip::udp::socket to a port and dispatches every received datagram as a message.
+     * Datagrams are drained in batches as soon as the socket becomes readable, on Linux using recvmmsg() to receive
+     * up to 'Batch Size' datagrams per system call. Every datagram is a message on its own, the 'Framing' property is
+     * ignored. UdpReceiver extends on SocketAdapter and is processed by the assigned SocketThread.
+     */
+    class NAPAPI UdpReceiver final : public SocketAdapter
+    {
+        RTTI_ENABLE(SocketAdapter)
+    public:
+        /**
+         * Initialization
+         * @param errorState contains error information
+         * @return true on success
+         */
+        bool init(utility::ErrorState& errorState) override;
+
+        /**
+         * Called before destruction
+         */
+        void onDestroy() override;
+    public:
+        // properties
+        int mPort                       = 13251;    ///< Property: 'Port' the port the receiver binds to
+        std::string mIPAddress          = "";       ///< Property: 'IP Address' local ip address to bind to, if left empty will bind to any local address
+        int mMaxDatagramSize            = 65507;    ///< Property: 'Max Datagram Size' size of the buffer of every datagram in bytes, larger datagrams are truncated
+        int mBatchSize                  = 16;       ///< Property: 'Batch Size' maximum number of datagrams received with a single system call, capped so the batch fits the largest size class of the SocketBufferPool
+        int mSocketReceiveBufferSize    = 0;        ///< Property: 'Socket Receive Buffer Size' size of the kernel receive buffer in bytes, 0 keeps the system default
+        bool mEnableLog                 = false;    ///< Property: 'Enable Log' whether the receiver should log to the console
+    public:
+        // Signals
+        /**
+         * Datagram received signal, dispatched on the thread this SocketAdapter is registered to, see SocketThread,
+         * or by SocketService::update() when 'Signal Delivery' is Main Thread.
+         * Only dispatched when 'Copy Received Messages' is enabled
+         */
+        Signal<const std::string&> messageReceived;
+
+        /**
+         * Datagram received signal passing a read-only view into the receive buffer, dispatched on the same thread as
+         * messageReceived. The view is only valid for the duration of the call, copy the data to keep it
+         */
+        Signal<std::string_view> messageViewReceived;
+
+        /**
+         * Datagrams received signal passing read-only views of all datagrams received with one batch, see 'Batch Size',
+         * dispatched on the same thread as messageReceived. Requires 'Batch Received Messages', which replaces the
+         * per-datagram receive signals. The views are only valid for the duration of the call
+         */
+        Signal<const std::vector<std::string_view>&> messageBatchReceived;
+    protected:
+        /**
+         * The process function
+         */
+        void process() override;
+
+        /**
+         * Triggers the signals of a receiver event, see EEvent
+         * @param event the event
+         */
+        void triggerEvent(const SocketEvent& event) override;
+    private:
+        /**
+         * Events delivered by the receiver
+         */
+        enum class EEvent : int
+        {
+            MESSAGE                 = 0,
+            MESSAGE_BATCH           = 1
+        };
+
+        /**
+         * Waits for the socket to become readable and drains it when it does
+         */
+        void receiveNext();
+
+        /**
+         * Receives all pending datagrams without blocking and dispatches them
+         * @return error that occurred while receiving, would_block is not an error
+         */
+        asio::error_code drain();
+
+        /**
+         * Receives a batch of datagrams without blocking
+         * @param count the number of datagrams received
+         * @return error that occurred while receiving
+         */
+        asio::error_code receiveBatch(size_t& count);
+
+        /**
+         * Dispatches a received datagram
+         * @param data pointer to the datagram
+         * @param size size of the datagram in bytes
+         */
+        void dispatch(const char* data, size_t size);
+
+        /**
+         * Triggers the receive signals of a datagram
+         * @param data pointer to the datagram
+         * @param size size of the datagram in bytes
+         * @param message string the datagram is copied into when received messages are copied
+         */
+        void triggerMessage(const char* data, size_t size, std::string& message);
+
+        /**
+         * Triggers the batch receive signal with the datagrams of the last received batch
+         */
+        void deliverReceivedBatch();
+
+        void logError(const std::string& message);
+
+        std::unique_ptr<asio::ip::udp::socket>  mSocket;
+        SocketBuffer                            mBuffer;            ///< holds 'Batch Size' datagrams of 'Max Datagram Size' bytes
+        std::vector<size_t>                     mReceivedSizes;     ///< size of every datagram received in the last batch
+        std::string                             mReceivedMessage;   ///< copy of the last received datagram, reused to avoid allocations
+        std::string                             mDeliveredMessage;  ///< copy of the last datagram delivered on the main thread
+        std::vector<std::string_view>           mReceivedBatch;     ///< datagrams of the last received batch
+        std::shared_ptr<std::atomic_bool>       mClosed = std::make_shared<std::atomic_bool>(false); ///< shared with queued handlers, which might run after destruction
+
+#ifdef __linux__
+        std::vector<mmsghdr>                    mMessageHeaders;    ///< header per datagram passed to recvmmsg()
+        std::vector<iovec>                      mMessageVectors;    ///< buffer per datagram referred to by the headers
+#endif
+    };
+}
@@ -0,0 +1,285 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#include "udpsender.h"
+#include "socketthread.h"
+
+// External includes
+#include <nap/logger.h>
+
+#ifdef __linux__
+#include <cerrno>
+#endif
+
+using asio::ip::udp;
+
+RTTI_BEGIN_CLASS(nap::UdpSender)
+    RTTI_PROPERTY("Endpoint",                   &nap::UdpSender::mRemoteIp,                 nap::rtti::EPropertyMetaData::Default)
+    RTTI_PROPERTY("Port",                       &nap::UdpSender::mPort,                     nap::rtti::EPropertyMetaData::Default)
+    RTTI_PROPERTY("Batch Size",                 &nap::UdpSender::mBatchSize,                nap::rtti::EPropertyMetaData::Default)
+    RTTI_PROPERTY("Broadcast",                  &nap::UdpSender::mBroadcast,                nap::rtti::EPropertyMetaData::Default)
+    RTTI_PROPERTY("Socket Send Buffer Size",    &nap::UdpSender::mSocketSendBufferSize,     nap::rtti::EPropertyMetaData::Default)
+    RTTI_PROPERTY("Enable Log",                 &nap::UdpSender::mEnableLog,                nap::rtti::EPropertyMetaData::Default)
+RTTI_END_CLASS
+
+namespace nap
+{
+    // maximum number of batches sent per process call before other adapters get a chance to run
+    static constexpr int sMaxBatchesPerProcess = 16;
+
+    //////////////////////////////////////////////////////////////////////////
+    // UdpSender
+    //////////////////////////////////////////////////////////////////////////
+
+    bool UdpSender::init(utility::ErrorState& errorState)
+    {
+        // when asio error occurs, init_success indicates whether initialization should fail or succeed
+        bool init_success = false;
+        asio::error_code asio_error_code;
+
+        if(!errorState.check(mBatchSize > 0, "Batch Size must be larger than 0"))
+            return false;
+
+        // create address from string
+        auto address = asio::ip::make_address(mRemoteIp, asio_error_code);
+        if (handleAsioError(asio_error_code, errorState, init_success))
+            return init_success;
+
+        // create socket, connected to the endpoint
+        udp::endpoint endpoint(address, mPort);
+        mSocket = std::make_unique<udp::socket>(getIOService());
+        mSocket->open(endpoint.protocol(), asio_error_code);
+        if (handleAsioError(asio_error_code, errorState, init_success))
+            return init_success;
+
+        if(mBroadcast)
+        {
+            mSocket->set_option(asio::socket_base::broadcast(true), asio_error_code);
+            if (handleAsioError(asio_error_code, errorState, init_success))
+                return init_success;
+        }
+
+        if(mSocketSendBufferSize > 0)
+        {
+            mSocket->set_option(asio::socket_base::send_buffer_size(mSocketSendBufferSize), asio_error_code);
+            if (handleAsioError(asio_error_code, errorState, init_success))
+                return init_success;
+        }
+
+        mSocket->connect(endpoint, asio_error_code);
+        if (handleAsioError(asio_error_code, errorState, init_success))
+            return init_success;
+
+        // datagrams are sent until the socket would block
+        mSocket->non_blocking(true, asio_error_code);
+        if (handleAsioError(asio_error_code, errorState, init_success))
+            return init_success;
+
+        // bound the outgoing queue
+        mQueue.setLimits(getQueueLimits());
+        mQueue.setMetrics(getEnabledMetrics());
+        mPending.reserve(mBatchSize);
+
+#ifdef __linux__
+        mMessageHeaders.resize(mBatchSize);
+        mMessageVectors.resize(mBatchSize);
+        for(size_t i = 0; i < mMessageHeaders.size(); i++)
+        {
+            mMessageHeaders[i] = {};
+            mMessageHeaders[i].msg_hdr.msg_iov = &mMessageVectors[i];
+            mMessageHeaders[i].msg_hdr.msg_iovlen = 1;
+        }
+#endif
+
+        // init the adapter
+        return SocketAdapter::init(errorState);
+    }
+
+
+    void UdpSender::onDestroy()
+    {
+        SocketAdapter::onDestroy();
+
+        // initialization failed before the socket was created
+        mClosed.store(true);
+        if(mSocket == nullptr)
+            return;
+
+        // close the socket on the thread handling it, cancels the pending wait
+        auto* socket = mSocket.get();
+        auto close = [socket]()
+        {
+            asio::error_code asio_error_code;
+            socket->close(asio_error_code);
+        };
+
+        if(isRunByOwnThread(getIOService()))
+        {
+            asio::post(getIOService(), close);
+        }else
+        {
+            close();
+        }
+
+        // make sure no other thread is still handling the socket
+        waitForHandlers();
+
+        // discard unsent datagrams, notifying their senders
+        for(auto& message : mPending)
+            message.complete(asio::error::operation_aborted);
+        mPending.clear();
+        mQueue.clear();
+    }
+
+
+    void UdpSender::send(const std::string& message)
+    {
+        send(SocketPayload(message), nullptr);
+    }
+
+
+    void UdpSender::send(const SocketPayload& payload)
+    {
+        send(payload, nullptr);
+    }
+
+
+    ESocketQueueResult UdpSender::send(const SocketPayload& payload, SocketSendCallback callback)
+    {
+        auto result = mQueue.push({ payload, std::move(callback) }, canBlockSender(getIOService()));
+        if(result == ESocketQueueResult::QUEUED)
+            requestProcess();
+
+        return result;
+    }
+
+
+    void UdpSender::process()
+    {
+        if(mWaitingForWritable || mClosed.load())
+            return;
+
+        auto err = flush();
+        if(err == asio::error::would_block || err == asio::error::try_again)
+        {
+            waitForWritable();
+        }else if(err)
+        {
+            logError(err.message());
+        }
+    }
+
+
+    asio::error_code UdpSender::flush()
+    {
+        size_t batch_size = static_cast<size_t>(mBatchSize);
+        for(int batch = 0; batch < sMaxBatchesPerProcess; batch++)
+        {
+            // top up the pending batch from the queue
+            SocketQueuedMessage message;
+            while(mPending.size() < batch_size && mQueue.pop(message))
+                mPending.emplace_back(std::move(message));
+
+            if(mPending.empty())
+                return {};
+
+            size_t count = 0;
+            auto err = sendBatch(count);
+            for(size_t i = 0; i < count; i++)
+            {
+                recordSent(mPending[i]);
+                mPending[i].complete({});
+            }
+
+            // a datagram the kernel refuses is dropped, otherwise it would block the queue forever
+            if(err && err != asio::error::would_block && err != asio::error::try_again && count < mPending.size())
+                mPending[count++].complete(err);
+
+            mPending.erase(mPending.begin(), mPending.begin() + count);
+            if(err)
+                return err;
+        }
+
+        // more datagrams might be queued, continue on the next process call
+        requestProcess();
+        return {};
+    }
+
+
+    asio::error_code UdpSender::sendBatch(size_t& count)
+    {
+        count = 0;
+
+#ifdef __linux__
+        for(size_t i = 0; i < mPending.size(); i++)
+        {
+            mMessageVectors[i].iov_base = const_cast<char*>(mPending[i].mPayload.data());
+            mMessageVectors[i].iov_len = mPending[i].mPayload.size();
+        }
+
+        int sent = ::sendmmsg(mSocket->native_handle(), mMessageHeaders.data(), static_cast<unsigned int>(mPending.size()), MSG_DONTWAIT);
+        if(sent < 0)
+            return asio::error_code(errno, asio::error::get_system_category());
+
+        count = static_cast<size_t>(sent);
+        return {};
+#else
+        // one datagram per system call, the socket is non-blocking
+        asio::error_code err;
+        for(; count < mPending.size(); count++)
+        {
+            mSocket->send(mPending[count].mPayload.buffer(), 0, err);
+            if(err)
+                break;
+        }
+        return err;
+#endif
+    }
+
+
+    void UdpSender::waitForWritable()
+    {
+        if(!isEventDriven())
+            return;
+
+        mWaitingForWritable = true;
+        mSocket->async_wait(udp::socket::wait_write, [this](const asio::error_code& errorCode)
+        {
+            mWaitingForWritable = false;
+
+            // socket closed or wait cancelled
+            if(errorCode)
+                return;
+
+            requestProcess();
+        });
+    }
+
+
+    SocketQueueDepth UdpSender::getQueueDepth() const
+    {
+        return mQueue.getDepth();
+    }
+
+
+    uint64 UdpSender::getDroppedCount() const
+    {
+        return mQueue.getDroppedCount();
+    }
+
+
+    SocketQueueDepth UdpSender::getTotalQueueDepth() const
+    {
+        return mQueue.getDepth();
+    }
+
+
+    void UdpSender::logError(const std::string& message)
+    {
+        if(mEnableLog)
+        {
+            nap::Logger::error(*this, message);
+        }
+    }
+}
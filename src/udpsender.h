@@ -0,0 +1,138 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#pragma once
+
+// External includes
+#include <vector>
+
+#ifdef __linux__
+#include <sys/socket.h>
+#include <sys/uio.h>
+#endif
+
+// ASIO includes
+#include <asio/ts/buffer.hpp>
+#include <asio/ts/internet.hpp>
+#include <asio/io_service.hpp>
+#include <asio/system_error.hpp>
+
+// Local includes
+#include "socketadapter.h"
+#include "socketpayload.h"
+#include "socketsendqueue.h"
+
+namespace nap
+{
+    //////////////////////////////////////////////////////////////////////////
+
+    /**
+     * UdpSender sends every message as a single datagram to a remote endpoint.
+     * Messages are queued, bounded by the 'Queue' properties of the SocketAdapter, and sent in batches by the assigned
+     * SocketThread, on Linux using sendmmsg() to send up to 'Batch Size' datagrams per system call. The socket is
+     * connected to the endpoint, so datagrams from other hosts are never received and no address is passed per send.
+     * The 'Framing' property is ignored, a datagram is a message on its own.
+     */
+    class NAPAPI UdpSender final : public SocketAdapter
+    {
+        RTTI_ENABLE(SocketAdapter)
+    public:
+        /**
+         * Initialization
+         * @param errorState contains error information
+         * @return true on success
+         */
+        bool init(utility::ErrorState& errorState) override;
+
+        /**
+         * Called before destruction
+         */
+        void onDestroy() override;
+
+        /**
+         * Send message as a single datagram. When the outgoing queue is full the 'Queue Overflow Policy' is applied,
+         * the DISCONNECT policy drops the message as there is no connection to close
+         * @param message the message
+         */
+        void send(const std::string& message);
+
+        /**
+         * Send payload as a single datagram
+         * @param payload the payload
+         */
+        void send(const SocketPayload& payload);
+
+        /**
+         * Send payload as a single datagram and get notified when it is handed to the kernel.
+         * The callback is invoked exactly once: on the thread processing this sender when the datagram is sent or
+         * discarded, or on the calling thread when the datagram is not queued, see SocketSendCallback
+         * @param payload the payload
+         * @param callback called with the result of sending the datagram, can be nullptr
+         * @return whether the payload is queued
+         */
+        ESocketQueueResult send(const SocketPayload& payload, SocketSendCallback callback);
+
+        /**
+         * Returns the number of datagrams and bytes waiting to be sent. Thread-safe
+         * @return the outgoing queue depth
+         */
+        SocketQueueDepth getQueueDepth() const;
+
+        /**
+         * Returns the number of datagrams dropped because the outgoing queue was full. Thread-safe
+         * @return the number of dropped datagrams
+         */
+        uint64 getDroppedCount() const;
+    public:
+        // properties
+        std::string mRemoteIp           = "127.0.0.1";  ///< Property: 'Endpoint' the ip address datagrams are sent to
+        int mPort                       = 13251;        ///< Property: 'Port' the port datagrams are sent to
+        int mBatchSize                  = 32;           ///< Property: 'Batch Size' maximum number of datagrams sent with a single system call
+        bool mBroadcast                 = false;        ///< Property: 'Broadcast' whether the endpoint is a broadcast address
+        int mSocketSendBufferSize       = 0;            ///< Property: 'Socket Send Buffer Size' size of the kernel send buffer in bytes, 0 keeps the system default
+        bool mEnableLog                 = false;        ///< Property: 'Enable Log' whether the sender should log to the console
+    protected:
+        /**
+         * The process function, sends queued datagrams
+         */
+        void process() override;
+
+        /**
+         * @return number of messages and bytes waiting to be sent
+         */
+        SocketQueueDepth getTotalQueueDepth() const override;
+    private:
+        /**
+         * Sends the pending batch without blocking, refilling it from the queue until the queue is drained
+         * @return error that occurred while sending, would_block when the socket buffer is full
+         */
+        asio::error_code flush();
+
+        /**
+         * Sends the first datagrams of the pending batch without blocking
+         * @param count the number of datagrams sent
+         * @return error that occurred while sending
+         */
+        asio::error_code sendBatch(size_t& count);
+
+        /**
+         * Waits for the socket to become writable and requests a process call when it does.
+         * Only has effect when the SocketThread is EVENT_DRIVEN, otherwise the next process call retries
+         */
+        void waitForWritable();
+
+        void logError(const std::string& message);
+
+        std::unique_ptr<asio::ip::udp::socket>  mSocket;
+        SocketSendQueue                         mQueue;
+        std::vector<SocketQueuedMessage>        mPending;           ///< datagrams dequeued but not sent yet, in order
+        bool                                    mWaitingForWritable = false;
+        std::atomic_bool                        mClosed = { false };
+
+#ifdef __linux__
+        std::vector<mmsghdr>                    mMessageHeaders;    ///< header per datagram passed to sendmmsg()
+        std::vector<iovec>                      mMessageVectors;    ///< buffer per datagram referred to by the headers
+#endif
+    };
+}